@@ -4,11 +4,13 @@
  *	Author: Timm Nygren
  *	
  *	Resources:
- *		http://linux.die.net/man/3/getdate_r		- info for getdate_r and error codes
+ *		http://linux.die.net/man/3/getdate_r		- info for getdate_r and error codes (date_parse.c follows it)
  *		https://gist.github.com/EmilHernvall/953968 - for a vector like data structure for reservations
  *
  */
 #include <errno.h>
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,14 +18,26 @@
 #include <unistd.h>
 
 #include "reservation.h"
+#include "res_journal.h"
+#include "res_stats.h"
+#include "res_tz.h"
+#include "date_parse.h"
+#include "crr_batch.h"
+#include "crr_server.h"
 #include "crr_utils.h"
 #include "search_sort_utils.h"
 
 int fileChanges = 0;	// REQ10
+char* batchfilename = NULL;
+char* importfilename = NULL;
+char* socketpath = NULL;
+char* statsfilename = NULL;
 char* reservationfilename;
 char** rooms;
 int numRooms = 0;
 resVect resList;
+resJournal journal = { .fd = -1 };
+resArena scratch;		// Short-lived memory of the menu command being run, reset after each one
 
 #define ERROR_CRR( fp, ...) crr_error( fp, __FUNCTION__, __LINE__, __VA_ARGS__ "" )		// REQ6
 
@@ -57,7 +71,12 @@ void cleanup( void )	// REQ4, I feel this is for the dynamic allocation requirem
 		}
 		free( rooms );
 	}
+	resJournal_close( &journal );
+	if( statsfilename )
+		resStats_write_file( statsfilename );
 	resVect_free( &resList );
+	resArena_free( &scratch );
+	resTz_free();
 
 	if( strcmp( RES_ERROR_STR, "" ) != 0 )
 	{
@@ -139,71 +158,49 @@ void setup_reservation( void )	// REQ3c
 	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
 	{
 		buff[strlen(buff)-1] = '\0';
-		result = getdate_r( buff, &brokendate );
-		if( result == 7 || result == 8 )
+		result = date_parse( buff, &brokendate );
+		if( result != 0 )
 		{
 			puts( "\nInvalid date. The following list contains valid inputs." );
 			print_format_list();
 			puts( "Enter a date and time to check or press enter to go back." );
 			continue;
-		} else if( result != 0 ) {	// REQ6
-			fprintf( stderr, "%s:%d: Error processing %s, with error code /%d/. Please source datemsk.sh\n", __FUNCTION__, __LINE__, buff, result ); 
-			puts( "Error converting date. Exiting program." );
-			puts( "Press enter to quit. . ." );
-			getchar();
-			exit(1);
 		}
 		timekey = mktime( &brokendate );
 
-		size_t* roomlookups = resVect_select_room_at_time( &resList, timekey, rooms, numRooms );
+		// The free room list lives in the command's scratch arena, so nothing here is freed
+		resQuery found;
+		resQuery_init( &found );
+		found.arena = &scratch;
+		int freecount = resVect_query_room_at_time( &resList, &found, timekey, rooms, numRooms );
 
 		strncpy( searchbuff, buff, 64 );
 		printf( "\nThe following rooms are available on %s.\n", buff );
-		if( roomlookups )
-		{
-			crr_print_menu( rooms, roomlookups, res_lookup_size, 1 );
-		} else {
-			print_rooms( rooms, numRooms, 1 );
-			res_lookup_size = numRooms;
-		}
+		crr_print_menu( rooms, found.hits, freecount, 1 );
 		puts( "Press enter to go back." );
 		int room;
 		while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
 		{
 			int err = sscanf(buff, "%d", &room);
-			if( err != 1 || room < 1 || room > res_lookup_size )
+			if( err != 1 || room < 1 || room > freecount )
 			{
 				puts( "\nInvalid room id.\n" );
 				printf( "The following rooms are available on %s.\n", searchbuff );
-				// crr_print_menu( rooms, roomlookups, res_lookup_size, 1 );
-				if( roomlookups )
-				{
-					crr_print_menu( rooms, roomlookups, res_lookup_size, 1 );
-				} else {
-					print_rooms( rooms, numRooms, 1 );
-					// res_lookup_size = numRooms;
-				}
+				crr_print_menu( rooms, found.hits, freecount, 1 );
 				puts( "Press enter to go back." );
 				continue;
 			}
 			room--;	// Make 0 offset
-			char* roomname;
-			if( roomlookups )
-				roomname = rooms[ roomlookups[room] ];
-			else
-				roomname = rooms[room];
+			char* roomname = rooms[ found.hits[room] ];
 
-			reservation res = new_reservation( roomname );
+			reservation res = new_reservation( roomname, &scratch );
 			reservation* conflict = resVect_add( &resList, res );	// REQ7
 			if( conflict )	// REQ7
 			{
 				puts( "\nThere was a conflicting reservation:" );
 				res_print_reservation( conflict );
 				printf( "\nThe following rooms are available on %s.\n", searchbuff );
-				if( roomlookups )
-					crr_print_menu( rooms, roomlookups, res_lookup_size, 1 );
-				else
-					print_rooms( rooms, numRooms, 1 );
+				crr_print_menu( rooms, found.hits, freecount, 1 );
 
 				puts( "Press enter to go back." );
 				continue;
@@ -213,35 +210,55 @@ void setup_reservation( void )	// REQ3c
 				break;
 			}
 		}
-
-		if( roomlookups )
-			free( roomlookups );	// REQ4
 		break;
 	}
 }
 
-#define SELECT( function ) function( &resList, key )
-// Used in options 2, 3, and 4
-void review_update_or_delete( size_t* roomlookups )		// REQ3c
+#define PAGE_SIZE 20		// Reservations listed at a time
+
+static void print_page( size_t* page, resOccurrence* occurrences, int count, int more )	// REQ3c
+{
+	puts( "\nHere are the reserved rooms." );
+	crr_print_reservations( &resList, page, occurrences, count );
+	if( more )
+		puts( "\nPick a reservation, or n for the next page. Press enter to go back." );
+	else
+		puts( "\nPick a reservation. Press enter to go back." );
+}
+
+// Used in options 2, 3, 4 and 5; only the page on screen is looked up
+void review_update_or_delete( resCursor* found )		// REQ3c
 {
 	char buff[BUFFLEN];
-	if( roomlookups ) 
+	size_t page[PAGE_SIZE];
+	resOccurrence occurrences[PAGE_SIZE];	// Options 2 and 5 list series occurrences too
+	int count = resCursor_fetch( found, page, occurrences, PAGE_SIZE );
+	if( count ) 
 	{
 		int choice = 0;
+		int more = count == PAGE_SIZE;
 
-		puts("\nHere are the reserved rooms.");
-		crr_print_reservations( &resList, roomlookups, res_lookup_size );
-		puts( "\nPick a reservation. Press enter to go back." );
+		print_page( page, occurrences, count, more );
 		while( fgets( buff, BUFFLEN, stdin ) )
 		{
 			if( buff[0] == '\n' )
 				return;
+			if( more && (buff[0] == 'n' || buff[0] == 'N') )
+			{
+				int next = resCursor_fetch( found, page, occurrences, PAGE_SIZE );
+				if( next )
+					count = next;
+				else
+					puts( "\nThere are no more reservations." );
+				more = next == PAGE_SIZE;
+				print_page( page, occurrences, count, more );
+				continue;
+			}
 			int err = sscanf( buff, "%d", &choice );
-			if( err != 1 || choice < 1 || choice > res_lookup_size )
+			if( err != 1 || choice < 1 || choice > count )
 			{
-				puts( "\nInvalid choice. Here are the reserved rooms.\n" );
-				crr_print_reservations( &resList, roomlookups, res_lookup_size );
-				puts( "\nPick a reservation. Press enter to go back." );
+				puts( "\nInvalid choice." );
+				print_page( page, occurrences, count, more );
 				continue;
 			}
 			break;
@@ -268,6 +285,20 @@ void review_update_or_delete( size_t* roomlookups )		// REQ3c
 
 		}
 
+		// An occurrence isn't a record of its own; deleting it leaves it out of its series
+		if( occurrences[choice].series >= 0 )
+		{
+			if( update == 1 )
+				puts( "\nOne occurrence of a recurring reservation can't be updated, only deleted.\n" );
+			else if( resVect_skip_occurrence( &resList, occurrences[choice].series, occurrences[choice].k ) == 0 ) {
+				fileChanges = 1;	// REQ10
+				puts( "\nThe occurrence was deleted.\n" );
+			} else {
+				puts( "\nThe occurrence couldn't be deleted; its series can't leave out any more.\n" );
+			}
+			return;
+		}
+
 		int room;
 		if( update == 1 )
 		{
@@ -287,7 +318,7 @@ void review_update_or_delete( size_t* roomlookups )		// REQ3c
 				break;
 			}
 
-			reservation* conflict = crr_update_reservation( rooms[room], &resList, roomlookups[choice] );	// REQ7
+			reservation* conflict = crr_update_reservation( rooms[room], &resList, page[choice], &scratch );	// REQ7
 
 			if( conflict )	// REQ7
 			{
@@ -298,11 +329,11 @@ void review_update_or_delete( size_t* roomlookups )		// REQ3c
 				puts( "\nYour reservation has been updated!\n" );
 			}
 		} else {
-			resVect_delete( &resList, roomlookups[choice] );
+			resVect_delete( &resList, page[choice] );
 			fileChanges = 1;	// REQ10
 			puts( "\nThe reservation was deleted.\n" );
 		} // update == 1
-	} else	// roomlookups
+	} else	// count
 		puts( "\nThere were no reservations found\n" );
 }
 
@@ -310,37 +341,32 @@ void review_update_or_delete( size_t* roomlookups )		// REQ3c
 void day_search( void )		// REQ3c
 {
 	char buff[BUFFLEN];
-	size_t* roomlookups = NULL;
+	resCursor found;
 	struct tm brokendate;
 	int result;
 	time_t key;
+	resCursor_init( &found );
+	found.q.arena = &scratch;
 	puts( "\nEnter a day of the week to check reservation. Press enter to go back." );
 	
 	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
 	{
 		buff[strlen(buff)-1] = '\0';
 
-		result = getdate_r( buff, &brokendate );
-		if( result == 7 || result == 8 )
+		result = date_parse( buff, &brokendate );
+		if( result != 0 )
 		{
 			puts( "\nPlease enter a day of the week (Monday, Tuesday...) to check reservation. Press enter to go back." );
 			continue;
-		} else if( result != 0 ) {
-			fprintf( stderr, "%s:%d: Error processing %s, with error code /%d/. Please source datemsk.sh\n", __FUNCTION__, __LINE__, buff, result ); 
-			puts( "\nError converting date. Exiting program." );
-			puts( "Press enter to quit. . ." );
-			getchar();
-			exit(1);
 		}
 
 		key = mktime( &brokendate );
-		roomlookups = SELECT( resVect_select_res_day );
+		resCursor_open_res_day( &found, &resList, key );
 		break;
 	}
 
-	review_update_or_delete( roomlookups );
-	if( roomlookups )
-		free( roomlookups );	// REQ4
+	review_update_or_delete( &found );
+	resCursor_close( &found );	// REQ4
 }
 
 // Option 3
@@ -348,8 +374,10 @@ void room_search( void )		// REQ3c
 {
 	char buff[ROOM_NAME_LEN];
 	char* key = NULL;
-	size_t* roomlookups = NULL;
+	resCursor found;
 	char** roomCheck = NULL;
+	resCursor_init( &found );
+	found.q.arena = &scratch;
 
 	puts( "\nHere is a list of valid room names.");
 	print_rooms( rooms, numRooms, 0 );
@@ -369,23 +397,14 @@ void room_search( void )		// REQ3c
 		puts( "\nEnter a room to check reservations over all days. Press enter to go back." );
 	}
 
-	key = calloc( ROOM_NAME_LEN, sizeof(char) );	// REQ4
-	if( !key )
-	{
-		fputs( "Could not allocate memory for key in room search.", stderr );
-		puts( "Something went wrong searching the given room. Exiting the program." );
-		exit(1);
-	}
+	key = resArena_calloc( &scratch, ROOM_NAME_LEN, sizeof(char) );	// REQ4
 	strncpy( key, buff, ROOM_NAME_LEN );
 
-	roomlookups = SELECT( resVect_select_res_room );
+	resCursor_open_res_room( &found, &resList, key );
 
-	review_update_or_delete( roomlookups );
+	review_update_or_delete( &found );
 
-	if( key )	// REQ4
-		free( key );
-	if( roomlookups )
-		free( roomlookups );
+	resCursor_close( &found );
 }
 
 // Option 4
@@ -393,7 +412,9 @@ void desc_search( void )	// REQ3c
 {
 	char buff[DESC_SIZE];
 	char* key = NULL;
-	size_t* roomlookups = NULL;
+	resCursor found;
+	resCursor_init( &found );
+	found.q.arena = &scratch;
 
 	puts( "\nEnter a word to search reservation descriptions. Press enter to go back." );
 
@@ -404,45 +425,221 @@ void desc_search( void )	// REQ3c
 
 	buff[strlen(buff)-1] = '\0';
 		
-	key = calloc( DESC_SIZE, sizeof(char) );	// REQ4
-	if( !key )
+	key = resArena_calloc( &scratch, DESC_SIZE, sizeof(char) );	// REQ4
+	strncpy( key, buff, DESC_SIZE );
+
+	resCursor_open_res_desc( &found, &resList, key );
+
+	review_update_or_delete( &found );
+
+	resCursor_close( &found );
+}
+
+// Reads one date for option 5; returns 0 when the user pressed enter to go back
+int read_range_time( const char* prompt, time_t* t )	// REQ3c
+{
+	char buff[BUFFLEN];
+	struct tm brokendate;
+
+	puts( prompt );
+	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
 	{
-		fputs( "Could not allocate memory for key in description search.", stderr );
-		puts( "Something went wrong searching the reservation descriptions. Exiting the program." );
-		exit(1);
+		buff[strlen(buff)-1] = '\0';
+		if( date_parse( buff, &brokendate ) != 0 )
+		{
+			puts( "Invalid format" );
+			print_format_list();
+			puts( prompt );
+			continue;
+		}
+		*t = mktime( &brokendate );
+		return 1;
 	}
-	strncpy( key, buff, DESC_SIZE );
+	return 0;
+}
+
+// Option 5
+void range_search( void )	// REQ3c
+{
+	time_t start, end;
+	resCursor found;
+	resCursor_init( &found );
+	found.q.arena = &scratch;
+
+	if( !read_range_time( "\nEnter the start of the time range. Press enter to go back.", &start ) )
+		return;
+	while( read_range_time( "\nEnter the end of the time range. Press enter to go back.", &end ) )
+	{
+		if( end < start )
+		{
+			puts( "\nThe end of the range must come after the start." );
+			continue;
+		}
+		resCursor_open_res_range( &found, &resList, start, end );
+		break;
+	}
+
+	review_update_or_delete( &found );
+	resCursor_close( &found );	// REQ4
+}
 
-	roomlookups = SELECT( resVect_select_res_desc );
+#define SLOT_CHOICES 5
+// Option 6
+void slot_search( void )	// REQ3c
+{
+	char buff[BUFFLEN];
+	int minutes = 0;
+	time_t start, end;
+
+	puts( "\nHow many minutes do you need the room for? Press enter to go back." );
+	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
+	{
+		if( sscanf( buff, "%d", &minutes ) == 1 && minutes > 0 )
+			break;
+		puts( "\nPlease enter a number of minutes. Press enter to go back." );
+		minutes = 0;
+	}
+	if( minutes <= 0 )
+		return;
+	if( !read_range_time( "\nEnter the earliest the reservation may start. Press enter to go back.", &start ) )
+		return;
+	if( !read_range_time( "\nEnter the latest the reservation may end. Press enter to go back.", &end ) )
+		return;
 
-	review_update_or_delete( roomlookups );
+	time_t now = time( NULL );
+	if( start < now )
+		start = now;
+	resQuery found;
+	resQuery_init( &found );
+	found.arena = &scratch;
+	int count = resVect_query_free_slots( &resList, &found, start, end, (time_t)minutes * 60, rooms, numRooms, SLOT_CHOICES );
+	if( !count )
+	{
+		puts( "\nNo room is free that long in that time.\n" );
+		return;
+	}
+	resFreeSlot* slots = found.slots;
 
-	if( key )	// REQ4
-		free( key );
-	if( roomlookups )
-		free( roomlookups );
+	puts( "\nThe earliest free times are:" );
+	crr_print_slots( rooms, slots, count );
+	puts( "\nPick a time to reserve it. Press enter to go back." );
+	int choice;
+	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
+	{
+		if( sscanf( buff, "%d", &choice ) != 1 || choice < 1 || choice > count )
+		{
+			puts( "\nInvalid choice. The earliest free times are:" );
+			crr_print_slots( rooms, slots, count );
+			puts( "\nPick a time to reserve it. Press enter to go back." );
+			continue;
+		}
+		resFreeSlot* slot = &slots[choice - 1];
+		char* desc = get_desc( &scratch );
+		reservation* conflict = resVect_add( &resList, create_reservation( rooms[slot->room], slot->start, slot->end, desc ) );	// REQ7
+		if( conflict )	// REQ7
+		{
+			puts( "\nThere was a conflicting reservation:" );
+			res_print_reservation( conflict );
+		} else {
+			fileChanges = 1;	// REQ10
+			puts( "\nYour reservation has been added!\n" );
+		}
+		break;
+	}
+}
+
+void print_usage( void )
+{
+	puts( "Usage: ./crr rooms.dat [schedule.dat] [--mmap] [--import bookings.csv] [--batch commands.txt] [--serve socket] [--stats file]" );
+	puts( "You must provide a file called 'rooms.dat' and must not be empty." );
+	puts( "The file 'schedule.dat' is optional. If nothing is provided, schedule.dat will be used for the file name." );
+	puts( "--mmap serves the schedule straight from a private mapping of the file instead of reading it all in." );
+	puts( "--import adds every booking in a CSV (room,start,end,description) or schedule.dat style file that fits." );
+	puts( "--batch runs the commands in the file ('-' for standard input) instead of the menus and saves once at the end." );
+	puts( "--serve keeps the schedule loaded and answers the same commands from clients on a Unix domain socket." );
+	puts( "--stats writes call counts and latency histograms to the file at exit; SIGUSR1 prints them to stderr at any time." );
 }
 
 void init( int argc, char* argv[] )
 {
-	if( argc < 2 || argc > 3 )	// REQ3a, REQ3b
+	static struct option longopts[] = {
+		{ "mmap", no_argument, NULL, 'm' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "import", required_argument, NULL, 'i' },
+		{ "serve", required_argument, NULL, 's' },
+		{ "stats", required_argument, NULL, 't' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int mapschedule = 0;
+	int opt;
+
+	while( (opt = getopt_long( argc, argv, "mb:i:s:t:", longopts, NULL )) != -1 )
+	{
+		switch( opt ) {
+			case 'm':
+				mapschedule = 1;
+				break;
+			case 'b':
+				batchfilename = optarg;
+				break;
+			case 'i':
+				importfilename = optarg;
+				break;
+			case 's':
+				socketpath = optarg;
+				break;
+			case 't':
+				statsfilename = optarg;
+				break;
+			default:
+				print_usage();
+				exit(1);
+		}
+	}
+
+	int nargs = argc - optind;
+	if( nargs < 1 || nargs > 2 )	// REQ3a, REQ3b
 	{
-		puts( "Usage: ./crr rooms.dat [schedule.dat]" );
-		puts( "You must provide a file called 'rooms.dat' and must not be empty." );
-		puts( "The file 'schedule.dat' is optional. If nothing is provided, schedule.dat will be used for the file name." );
+		print_usage();
 		exit(1);
-	} else if ( argc == 2 ) {
+	} else if ( nargs == 1 ) {
 		reservationfilename = "schedule.dat";	// REQ3b
 	} else {
-		reservationfilename = argv[2];			// REQ3b
+		reservationfilename = argv[optind + 1];	// REQ3b
 	}
 	atexit( cleanup );
-	setup_rooms( argv[1] );		// REQ3a
+	resStats_install_handler( SIGUSR1 );
+	setup_rooms( argv[optind] );		// REQ3a
+	resArena_init( &scratch );
 	resVect_init( &resList );
+	resVect_set_rooms( &resList, rooms, numRooms );
 
-	resVect_read_file( &resList, reservationfilename );			// REQ3b
+	if( mapschedule )
+		resVect_map_file( &resList, reservationfilename );		// REQ3b
+	else
+		resVect_read_file( &resList, reservationfilename );		// REQ3b
+	resVect_read_series( &resList, reservationfilename );	// REQ3b
 	resVect_check_consistency( &resList, rooms, numRooms );		// REQ8
 
+	// Changes from a session that never reached the save prompt are still in the journal
+	int opened = resJournal_open( &journal, reservationfilename );
+	if( opened == JOURNAL_BUSY )	// REQ6
+	{
+		fprintf( stderr, "%s is already in use by another crr (its journal %s is locked).\n", reservationfilename, journal.filename );
+		snprintf( RES_ERROR_STR, BUFF, "Schedule already in use. Quitting the program." );
+		exit(1);
+	}
+	if( opened == 0 )
+	{
+		int recovered = resJournal_replay( &journal, &resList );
+		if( recovered )
+		{
+			// Batch output is for programs; keep the notice out of it
+			fprintf( batchfilename || importfilename || socketpath ? stderr : stdout, "Recovered %d unsaved change(s) from %s.\n", recovered, journal.filename );
+			fileChanges = 1;	// REQ10
+		}
+		resList.journal = &journal;
+	}
 }
 
 // Clears the input buffer when saving
@@ -454,9 +651,47 @@ void clear_input_buffer( void )
 	} while( c != '\n' && c != EOF );
 }
 
+// Runs an import, a command file and/or the server instead of the menus, saving once if anything changed
+int run_batch( void )
+{
+	batchContext ctx;
+	crr_batch_init( &ctx, &resList, rooms, numRooms );
+
+	if( importfilename )
+		crr_batch_import( &ctx, importfilename, stdout );
+
+	if( batchfilename )
+	{
+		FILE* in = strcmp( batchfilename, "-" ) == 0 ? stdin : fopen( batchfilename, "r" );
+		if( !in )	// REQ6
+		{
+			fprintf( stderr, "%s:%d: Cannot open batch file %s: %s\n", __FUNCTION__, __LINE__, batchfilename, strerror( errno ) );
+			return 1;
+		}
+		crr_batch_run( &ctx, in, stdout );
+		if( in != stdin )
+			fclose( in );
+	}
+
+	if( socketpath )
+	{
+		ctx.changes += fileChanges;		// REQ10
+		int served = crr_serve( &ctx, socketpath, &journal, reservationfilename );
+		crr_batch_free( &ctx );	// REQ4
+		return served == 0 ? 0 : 1;
+	}
+
+	if( ctx.changes || fileChanges )		// REQ10
+		resJournal_checkpoint( &journal, &resList, reservationfilename, 1 );
+	crr_batch_free( &ctx );	// REQ4
+	return 0;
+}
+
 int main( int argc, char* argv[] )
 {
 	init( argc, argv );
+	if( batchfilename || importfilename || socketpath )
+		return run_batch();
 
 	puts( "Welcome to Console Room Reservation!\n" );	// REQ3c
 	main_menu();
@@ -466,7 +701,7 @@ int main( int argc, char* argv[] )
 	while( fgets( buff, BUFFLEN, stdin ) && buff[0] != '\n' )
 	{
 		int err = sscanf(buff, "%d", &choice);
-		if( err != 1 || choice < 1 || choice > 4 )		// REQ6
+		if( err != 1 || choice < 1 || choice > 6 )		// REQ6
 		{
 			puts( "\nInvalid choice.\n" );
 			main_menu();
@@ -485,7 +720,17 @@ int main( int argc, char* argv[] )
 			case 4:
 				desc_search();
 				break;
+			case 5:
+				range_search();
+				break;
+			case 6:
+				slot_search();
+				break;
 		}
+		// Everything this command changed is made durable before we wait on the user again. The journal
+		// is never folded in here: answering N at the save prompt has to be able to undo all of it.
+		resJournal_sync( &journal );
+		resArena_reset( &scratch );
 		main_menu();
 	}
 
@@ -499,11 +744,12 @@ int main( int argc, char* argv[] )
 			puts( "\nReservations saved!\n" );
 			if( fileChanges )		// REQ10
 			{
-				resVect_write_file( &resList, reservationfilename );
+				resJournal_checkpoint( &journal, &resList, reservationfilename, 1 );
 			}
 			break;
 		} else if( c == 'n' || c == 'N' ) {
 			puts( "\nReservations were not saved.\n" );
+			resJournal_discard( &journal );
 			break;
 		}
 		puts( "Please enter Y or N to save." );
@@ -0,0 +1,836 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "date_parse.h"
+#include "search_sort_utils.h"
+#include "res_recur.h"
+#include "crr_batch.h"
+
+#define BATCH_MAX_FIELDS 8
+#define BATCH_TIME_FORMAT "%Y/%m/%d %I:%M%p"	// One of the formats date_parse reads back
+
+void crr_batch_init( batchContext* ctx, resVect* v, char** rooms, int numrooms )
+{
+	ctx->v = v;
+	ctx->rooms = rooms;
+	ctx->numrooms = numrooms;
+	ctx->changes = 0;
+	ctx->failures = 0;
+	resArena_init( &ctx->scratch );
+}
+
+void crr_batch_free( batchContext* ctx )	// REQ4
+{
+	resArena_free( &ctx->scratch );
+}
+
+// A query whose buffers are taken from the command's scratch arena
+static void scratch_query( batchContext* ctx, resQuery* q )
+{
+	resQuery_init( q );
+	q->arena = &ctx->scratch;
+}
+
+static void scratch_cursor( batchContext* ctx, resCursor* c )
+{
+	resCursor_init( c );
+	c->q.arena = &ctx->scratch;
+}
+
+static char* trim( char* s )
+{
+	while( isspace( (unsigned char)*s ) )
+		s++;
+	char* end = s + strlen( s );
+	while( end > s && isspace( (unsigned char)end[-1] ) )
+		*--end = '\0';
+	return s;
+}
+
+// Cuts line at every '|' and returns the number of fields
+static int split_fields( char* line, char** fields )
+{
+	int count = 0;
+	fields[count++] = line;
+	for( char* p = line; *p; p++ )
+	{
+		if( *p == '|' && count < BATCH_MAX_FIELDS )
+		{
+			*p = '\0';
+			fields[count++] = p + 1;
+		}
+	}
+	for( int i = 0; i < count; i++ )
+		fields[i] = trim( fields[i] );
+	return count;
+}
+
+static int fail( batchContext* ctx, FILE* out, const char* message )
+{
+	ctx->failures++;
+	fprintf( out, "error\t%s\n", message );
+	return -1;
+}
+
+static void print_time( FILE* out, time_t stored )
+{
+	char buff[64];
+	struct tm local;
+	time_t t = to_local( stored );		// REQ11
+	localtime_r( &t, &local );
+	strftime( buff, sizeof(buff), BATCH_TIME_FORMAT, &local );
+	fputs( buff, out );
+}
+
+static void print_res( FILE* out, resVect* v, size_t index )
+{
+	reservation* res = resVect_get( v, index );
+	fprintf( out, "res\t%zu\t%s\t", index, res->roomname );
+	print_time( out, res->starttime );
+	fputc( '\t', out );
+	print_time( out, res->endtime );
+	fprintf( out, "\t%s\n", res->description );
+}
+
+static void print_occurrence( FILE* out, int series, int k, reservation* res )
+{
+	fprintf( out, "occ\t%d\t%d\t%s\t", series, k, res->roomname );
+	print_time( out, res->starttime );
+	fputc( '\t', out );
+	print_time( out, res->endtime );
+	fprintf( out, "\t%s\n", res->description );
+}
+
+// Reads the optional limit and offset fields starting at fields[at]; empty or left out means no limit or offset
+static int parse_page( char** fields, int count, int at, int* limit, int* offset )
+{
+	*limit = -1;
+	*offset = 0;
+	if( count > at && fields[at][0] && (sscanf( fields[at], "%d", limit ) != 1 || *limit < 0) )
+		return -1;
+	if( count > at + 1 && fields[at + 1][0] && (sscanf( fields[at + 1], "%d", offset ) != 1 || *offset < 0) )
+		return -1;
+	return 0;
+}
+
+// Prints the page of the cursor's results asked for; the rest are never looked up
+static int print_cursor( batchContext* ctx, FILE* out, resCursor* found, int limit, int offset )
+{
+	int count = 0;
+	resCursor_skip( found, offset );
+	resCursor_limit( found, limit );
+	for( ; resCursor_next( found ); count++ )
+	{
+		if( found->occurrence.series >= 0 )
+			print_occurrence( out, found->occurrence.series, found->occurrence.k, &found->occurrence.res );
+		else
+			print_res( out, ctx->v, found->hit );
+	}
+	fprintf( out, "ok\t%d\n", count );
+	resCursor_close( found );	// REQ4
+	return 0;
+}
+
+static int parse_time( const char* text, time_t* t )
+{
+	struct tm tm;
+	if( date_parse( text, &tm ) != 0 )
+		return -1;
+	*t = mktime( &tm );
+	return 0;
+}
+
+// The rooms.dat spelling of a room name, or NULL if it isn't one
+static char* find_room( batchContext* ctx, const char* name )
+{
+	char** found = bsearch( name, ctx->rooms, ctx->numrooms, sizeof(char*), bsearch_room_cmp );	// REQ5
+	return found ? *found : NULL;
+}
+
+static int parse_index( batchContext* ctx, const char* text, int* index )
+{
+	char* end;
+	long value = strtol( text, &end, 10 );
+	if( !*text || *end || value < 0 || value >= resVect_count( ctx->v ) )
+		return -1;
+	*index = (int)value;
+	return 0;
+}
+
+// Copies a description, turning tabs into spaces so output columns stay intact
+static void copy_desc( char* desc, const char* text )
+{
+	strncpy( desc, text, DESC_SIZE - 1 );
+	desc[DESC_SIZE - 1] = '\0';
+	for( char* p = desc; *p; p++ )
+	{
+		if( *p == '\t' )
+			*p = ' ';
+	}
+}
+
+static int conflict( batchContext* ctx, FILE* out, reservation* res )
+{
+	resVect* v = ctx->v;
+	ctx->failures++;
+
+	// A series in the way comes back as an occurrence, which is looked up again to name it
+	if( res == &v->occurrence )
+	{
+		for( int i = 0; i < v->seriescount; i++ )
+		{
+			int k = strcasecmp( v->series[i].first.roomname, res->roomname ) == 0 ? resRecur_overlap( &v->series[i], res->starttime, res->endtime ) : -1;
+			if( k >= 0 )
+			{
+				print_occurrence( out, i, k, res );
+				break;
+			}
+		}
+	} else {
+		print_res( out, v, res - resVect_get( v, 0 ) );
+	}
+	fputs( "conflict\t1\n", out );
+	return -1;
+}
+
+static int cmd_reserve( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t start, end;
+	if( count != 5 )
+		return fail( ctx, out, "usage: reserve|room|start|end|description" );
+
+	char* room = find_room( ctx, fields[1] );
+	if( !room )
+		return fail( ctx, out, "unknown room" );
+	if( parse_time( fields[2], &start ) != 0 || parse_time( fields[3], &end ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( start < time( NULL ) )
+		return fail( ctx, out, "start is in the past" );
+	if( start > end )
+		return fail( ctx, out, "end comes before start" );
+
+	char desc[DESC_SIZE];
+	copy_desc( desc, fields[4] );
+	reservation* clash = resVect_add( ctx->v, create_reservation( room, start, end, desc ) );	// REQ7
+	if( clash )
+		return conflict( ctx, out, clash );
+
+	ctx->changes++;
+	print_res( out, ctx->v, resVect_count( ctx->v ) - 1 );
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+static int cmd_free( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t key;
+	if( count != 2 )
+		return fail( ctx, out, "usage: free|date" );
+	if( parse_time( fields[1], &key ) != 0 )
+		return fail( ctx, out, "invalid date" );
+
+	resQuery available;
+	scratch_query( ctx, &available );
+	int freecount = resVect_query_room_at_time( ctx->v, &available, key, ctx->rooms, ctx->numrooms );
+	for( int i = 0; i < freecount; i++ )
+		fprintf( out, "room\t%zu\t%s\n", available.hits[i], ctx->rooms[available.hits[i]] );
+	fprintf( out, "ok\t%d\n", freecount );
+	return 0;
+}
+
+static int cmd_day( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t key;
+	int limit, offset;
+	if( count < 2 || count > 4 )
+		return fail( ctx, out, "usage: day|date[|limit[|offset]]" );
+	if( parse_time( fields[1], &key ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( parse_page( fields, count, 2, &limit, &offset ) != 0 )
+		return fail( ctx, out, "limit and offset must be numbers" );
+
+	resCursor found;
+	scratch_cursor( ctx, &found );
+	resCursor_open_res_day( &found, ctx->v, key );
+	return print_cursor( ctx, out, &found, limit, offset );
+}
+
+static int cmd_range( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t start, end;
+	int limit, offset;
+	if( count < 3 || count > 5 )
+		return fail( ctx, out, "usage: range|start|end[|limit[|offset]]" );
+	if( parse_time( fields[1], &start ) != 0 || parse_time( fields[2], &end ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( start > end )
+		return fail( ctx, out, "end comes before start" );
+	if( parse_page( fields, count, 3, &limit, &offset ) != 0 )
+		return fail( ctx, out, "limit and offset must be numbers" );
+
+	resCursor found;
+	scratch_cursor( ctx, &found );
+	resCursor_open_res_range( &found, ctx->v, start, end );
+	return print_cursor( ctx, out, &found, limit, offset );
+}
+
+#define BATCH_SLOTS 1		// Slots answered when the count field is left out
+
+static int cmd_slots( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t start, end;
+	int minutes = 0;
+	int wanted = BATCH_SLOTS;
+	if( count < 4 || count > 6 )
+		return fail( ctx, out, "usage: slots|minutes|start|end[|count[|room,room...]]" );
+	if( sscanf( fields[1], "%d", &minutes ) != 1 || minutes <= 0 )
+		return fail( ctx, out, "minutes must be a positive number" );
+	if( parse_time( fields[2], &start ) != 0 || parse_time( fields[3], &end ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( count > 4 && fields[4][0] && (sscanf( fields[4], "%d", &wanted ) != 1 || wanted <= 0) )
+		return fail( ctx, out, "count must be a positive number" );
+
+	// Only the listed rooms are searched when a room list is given
+	char** rooms = ctx->rooms;
+	int numrooms = ctx->numrooms;
+	char* picked[ctx->numrooms ? ctx->numrooms : 1];
+	if( count > 5 && fields[5][0] )
+	{
+		numrooms = 0;
+		char* save;
+		for( char* name = strtok_r( fields[5], ",", &save ); name; name = strtok_r( NULL, ",", &save ) )
+		{
+			char* room = find_room( ctx, trim( name ) );
+			if( !room )
+				return fail( ctx, out, "unknown room" );
+			if( numrooms < ctx->numrooms )
+				picked[numrooms++] = room;
+		}
+		rooms = picked;
+	}
+
+	time_t now = time( NULL );
+	if( start < now )
+		start = now;
+	resQuery q;
+	scratch_query( ctx, &q );
+	int found = resVect_query_free_slots( ctx->v, &q, start, end, (time_t)minutes * 60, rooms, numrooms, wanted );
+	resFreeSlot* slots = q.slots;
+	for( int i = 0; i < found; i++ )
+	{
+		fprintf( out, "slot\t%s\t", rooms[slots[i].room] );
+		print_time( out, to_utc( slots[i].start ) );		// REQ11
+		fputc( '\t', out );
+		print_time( out, to_utc( slots[i].end ) );
+		fputc( '\n', out );
+	}
+	fprintf( out, "ok\t%d\n", found );
+	return 0;
+}
+
+static int cmd_room( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int limit, offset;
+	if( count < 2 || count > 4 )
+		return fail( ctx, out, "usage: room|room[|limit[|offset]]" );
+
+	char* room = find_room( ctx, fields[1] );
+	if( !room )
+		return fail( ctx, out, "unknown room" );
+	if( parse_page( fields, count, 2, &limit, &offset ) != 0 )
+		return fail( ctx, out, "limit and offset must be numbers" );
+
+	resCursor found;
+	scratch_cursor( ctx, &found );
+	resCursor_open_res_room( &found, ctx->v, room );
+	return print_cursor( ctx, out, &found, limit, offset );
+}
+
+static int cmd_desc( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int limit, offset;
+	if( count < 2 || count > 4 )
+		return fail( ctx, out, "usage: desc|text[|limit[|offset]]" );
+	if( parse_page( fields, count, 2, &limit, &offset ) != 0 )
+		return fail( ctx, out, "limit and offset must be numbers" );
+
+	resCursor found;
+	scratch_cursor( ctx, &found );
+	resCursor_open_res_desc( &found, ctx->v, fields[1] );
+	return print_cursor( ctx, out, &found, limit, offset );
+}
+
+static int cmd_word( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int limit, offset;
+	if( count < 2 || count > 4 || !resWords_is_word( fields[1] ) )
+		return fail( ctx, out, "usage: word|word[|limit[|offset]]" );
+	if( parse_page( fields, count, 2, &limit, &offset ) != 0 )
+		return fail( ctx, out, "limit and offset must be numbers" );
+
+	resCursor found;
+	scratch_cursor( ctx, &found );
+	resCursor_open_res_word( &found, ctx->v, fields[1] );
+	return print_cursor( ctx, out, &found, limit, offset );
+}
+
+static int cmd_update( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int index;
+	if( count != 6 )
+		return fail( ctx, out, "usage: update|index|room|start|end|description" );
+	if( parse_index( ctx, fields[1], &index ) != 0 )
+		return fail( ctx, out, "no reservation at that index" );
+
+	reservation res = *resVect_get( ctx->v, index );
+	if( fields[2][0] )
+	{
+		char* room = find_room( ctx, fields[2] );
+		if( !room )
+			return fail( ctx, out, "unknown room" );
+		strncpy( res.roomname, room, ROOM_NAME_LEN );
+	}
+	time_t t;
+	if( fields[3][0] )
+	{
+		if( parse_time( fields[3], &t ) != 0 )
+			return fail( ctx, out, "invalid date" );
+		if( t < time( NULL ) )
+			return fail( ctx, out, "start is in the past" );
+		res.starttime = to_utc( t );	// REQ11
+	}
+	if( fields[4][0] )
+	{
+		if( parse_time( fields[4], &t ) != 0 )
+			return fail( ctx, out, "invalid date" );
+		res.endtime = to_utc( t );		// REQ11
+	}
+	if( res.starttime > res.endtime )
+		return fail( ctx, out, "end comes before start" );
+	if( fields[5][0] )
+		copy_desc( res.description, fields[5] );
+
+	reservation* clash = resVect_update( ctx->v, index, res );	// REQ7
+	if( clash )
+		return conflict( ctx, out, clash );
+
+	ctx->changes++;
+	print_res( out, ctx->v, index );
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+static int cmd_delete( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int index;
+	if( count != 2 )
+		return fail( ctx, out, "usage: delete|index" );
+	if( parse_index( ctx, fields[1], &index ) != 0 )
+		return fail( ctx, out, "no reservation at that index" );
+
+	resVect_delete( ctx->v, index );
+	ctx->changes++;
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+static void print_series( FILE* out, resVect* v, int index )
+{
+	resRecur* r = &v->series[index];
+	fprintf( out, "series\t%d\t%s\t", index, r->first.roomname );
+	print_time( out, r->first.starttime );
+	fputc( '\t', out );
+	print_time( out, r->first.endtime );
+	fprintf( out, "\t%s\t%d\t%d\t%d\t%s\n", resRecur_freq_name( r->freq ), r->interval, r->count, r->exceptioncount, r->first.description );
+}
+
+static int cmd_repeat( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t start, end, until = 0;
+	int freq, interval, occurrences = 0;
+	char* rest;
+	if( count != 8 )
+		return fail( ctx, out, "usage: repeat|room|start|end|daily/weekly/monthly|interval|count or until date|description" );
+
+	char* room = find_room( ctx, fields[1] );
+	if( !room )
+		return fail( ctx, out, "unknown room" );
+	if( parse_time( fields[2], &start ) != 0 || parse_time( fields[3], &end ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( start < time( NULL ) )
+		return fail( ctx, out, "start is in the past" );
+	if( start > end )
+		return fail( ctx, out, "end comes before start" );
+	if( !(freq = resRecur_freq( fields[4] )) )
+		return fail( ctx, out, "repeat daily, weekly or monthly" );
+	interval = (int)strtol( fields[5], &rest, 10 );
+	if( !fields[5][0] || *rest || interval < 1 )
+		return fail( ctx, out, "interval must be a positive number" );
+
+	// The last field is either a number of occurrences or the date they stop by
+	occurrences = (int)strtol( fields[6], &rest, 10 );
+	if( !fields[6][0] || *rest )
+	{
+		occurrences = 0;
+		if( parse_time( fields[6], &until ) != 0 )
+			return fail( ctx, out, "invalid date" );
+		until = to_utc( until );	// REQ11
+	} else if( occurrences < 1 ) {
+		return fail( ctx, out, "count must be a positive number" );
+	}
+
+	char desc[DESC_SIZE];
+	copy_desc( desc, fields[7] );
+	resRecur series;
+	if( resRecur_init( &series, create_reservation( room, start, end, desc ), freq, interval, occurrences, until ) != 0 )
+		return fail( ctx, out, "occurrences would overlap, or there are none or too many" );
+
+	reservation* clash = resVect_add_series( ctx->v, &series );		// REQ7
+	if( clash )
+		return conflict( ctx, out, clash );
+
+	ctx->changes++;
+	print_series( out, ctx->v, ctx->v->seriescount - 1 );
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+static int cmd_series( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	(void)fields;
+	if( count != 1 )
+		return fail( ctx, out, "usage: series" );
+	for( int i = 0; i < ctx->v->seriescount; i++ )
+		print_series( out, ctx->v, i );
+	fprintf( out, "ok\t%d\n", ctx->v->seriescount );
+	return 0;
+}
+
+static int cmd_occurrences( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	time_t start, end;
+	if( count != 3 )
+		return fail( ctx, out, "usage: occurrences|start|end" );
+	if( parse_time( fields[1], &start ) != 0 || parse_time( fields[2], &end ) != 0 )
+		return fail( ctx, out, "invalid date" );
+	if( start > end )
+		return fail( ctx, out, "end comes before start" );
+
+	resQuery q;
+	scratch_query( ctx, &q );
+	int n = resVect_query_occurrences( ctx->v, &q, start, end );
+	for( int i = 0; i < n; i++ )
+		print_occurrence( out, q.occurrences[i].series, q.occurrences[i].k, &q.occurrences[i].res );
+	fprintf( out, "ok\t%d\n", n );
+	return 0;
+}
+
+static int parse_series( batchContext* ctx, const char* text, int* series )
+{
+	char* end;
+	long value = strtol( text, &end, 10 );
+	if( !*text || *end || value < 0 || value >= ctx->v->seriescount )
+		return -1;
+	*series = (int)value;
+	return 0;
+}
+
+static int cmd_skip( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int series;
+	char* end;
+	if( count != 3 )
+		return fail( ctx, out, "usage: skip|series|occurrence" );
+	if( parse_series( ctx, fields[1], &series ) != 0 )
+		return fail( ctx, out, "no series at that index" );
+	long k = strtol( fields[2], &end, 10 );
+	if( !fields[2][0] || *end || resVect_skip_occurrence( ctx->v, series, (int)k ) != 0 )
+		return fail( ctx, out, "no such occurrence, or too many skipped already" );
+
+	ctx->changes++;
+	print_series( out, ctx->v, series );
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+static int cmd_unrepeat( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	int series;
+	if( count != 2 )
+		return fail( ctx, out, "usage: unrepeat|series" );
+	if( parse_series( ctx, fields[1], &series ) != 0 )
+		return fail( ctx, out, "no series at that index" );
+
+	resVect_delete_series( ctx->v, series );
+	ctx->changes++;
+	fputs( "ok\t1\n", out );
+	return 0;
+}
+
+// Drops a rejected import record, saying why
+static void skip( FILE* out, int recno, const char* reason )
+{
+	fprintf( out, "skip\t%d\t%s\n", recno, reason );
+}
+
+// Reads a whole file into memory; returns NULL with errno set on failure
+static char* slurp( const char* filename, size_t* length )
+{
+	FILE* fp = fopen( filename, "rb" );
+	if( !fp )
+		return NULL;
+
+	size_t size = 4096;
+	size_t used = 0;
+	char* buff = malloc( size + 1 );	// REQ4
+	while( buff )
+	{
+		used += fread( buff + used, 1, size - used, fp );
+		if( used < size )
+			break;
+		size *= 2;
+		char* bigger = realloc( buff, size + 1 );	// REQ4
+		if( !bigger )
+			free( buff );
+		buff = bigger;
+	}
+	int failed = ferror( fp );
+	fclose( fp );
+	if( !buff || failed )
+	{
+		if( buff )
+			free( buff );
+		return NULL;
+	}
+	buff[used] = '\0';
+	*length = used;
+	return buff;
+}
+
+/***
+ * Parses an import file into incoming, recording for each kept record its
+ * number in the file (1-based) in recnos. Raw schedule.dat records are
+ * recognized by the NUL padding every record has; anything else is read as
+ * CSV lines of room,start,end,description where the description runs to the
+ * end of the line. Returns how many records were kept.
+ */
+static int read_import( batchContext* ctx, char* text, size_t length, reservation* incoming, int* recnos, FILE* out )
+{
+	int kept = 0;
+
+	if( memchr( text, '\0', length ) )
+	{
+		reservation* records = (reservation*)text;
+		for( size_t i = 0; i < length / sizeof(reservation); i++ )
+		{
+			char* room = find_room( ctx, records[i].roomname );
+			if( !room )
+			{
+				skip( out, i + 1, "unknown room" );
+				continue;
+			}
+			if( records[i].starttime > records[i].endtime )
+			{
+				skip( out, i + 1, "end comes before start" );
+				continue;
+			}
+			incoming[kept] = records[i];
+			incoming[kept].roomname[ROOM_NAME_LEN - 1] = '\0';
+			incoming[kept].description[DESC_SIZE - 1] = '\0';
+			recnos[kept++] = i + 1;
+		}
+		return kept;
+	}
+
+	int recno = 0;
+	char* save;
+	for( char* line = strtok_r( text, "\n", &save ); line; line = strtok_r( NULL, "\n", &save ) )
+	{
+		recno++;
+		line[strcspn( line, "\r" )] = '\0';
+		line = trim( line );
+		if( !*line || *line == '#' )
+			continue;
+
+		char* fields[4];
+		int count = 0;
+		fields[count++] = line;
+		for( char* p = line; *p && count < 4; p++ )
+		{
+			if( *p == ',' )
+			{
+				*p = '\0';
+				fields[count++] = p + 1;
+			}
+		}
+		for( int i = 0; i < count; i++ )
+			fields[i] = trim( fields[i] );
+
+		// A header naming the columns is allowed on the first line
+		if( recno == 1 && strcasecmp( fields[0], "room" ) == 0 )
+			continue;
+		if( count != 4 )
+		{
+			skip( out, recno, "expected room,start,end,description" );
+			continue;
+		}
+
+		time_t start, end;
+		char* room = find_room( ctx, fields[0] );
+		if( !room )
+		{
+			skip( out, recno, "unknown room" );
+			continue;
+		}
+		if( parse_time( fields[1], &start ) != 0 || parse_time( fields[2], &end ) != 0 )
+		{
+			skip( out, recno, "invalid date" );
+			continue;
+		}
+		if( start > end )
+		{
+			skip( out, recno, "end comes before start" );
+			continue;
+		}
+
+		char desc[DESC_SIZE];
+		size_t desclen = strlen( fields[3] );
+		if( desclen >= 2 && fields[3][0] == '"' && fields[3][desclen - 1] == '"' )
+		{
+			fields[3][desclen - 1] = '\0';
+			fields[3]++;
+		}
+		copy_desc( desc, fields[3] );
+		incoming[kept] = create_reservation( room, start, end, desc );
+		recnos[kept++] = recno;
+	}
+	return kept;
+}
+
+// Bulk adds the reservations in a CSV or raw schedule file, reporting each one left out
+int crr_batch_import( batchContext* ctx, const char* filename, FILE* out )
+{
+	size_t length;
+	char* text = slurp( filename, &length );
+	if( !text )
+		return fail( ctx, out, strerror( errno ? errno : ENOMEM ) );
+
+	// Every CSV record takes at least a line, and raw records are bigger than lines
+	size_t most = length / sizeof(reservation) + 1;
+	for( size_t i = 0; i < length; i++ )
+	{
+		if( text[i] == '\n' )
+			most++;
+	}
+	reservation* incoming = malloc( sizeof(reservation) * most );		// REQ4
+	int* recnos = malloc( sizeof(int) * most );							// REQ4
+	resImportConflict* conflicts = malloc( sizeof(resImportConflict) * most );	// REQ4
+	if( !incoming || !recnos || !conflicts )	// REQ6
+	{
+		fputs( "Error allocating memory to import reservations.", stderr );
+		snprintf( RES_ERROR_STR, BUFF, "Error importing reservations. Quitting the program." );
+		exit(1);
+	}
+
+	int n = read_import( ctx, text, length, incoming, recnos, out );
+	int added = resVect_import( ctx->v, incoming, n, conflicts );
+
+	char reason[64];
+	for( int i = 0; i < n; i++ )
+	{
+		if( conflicts[i].existing >= 0 )
+			snprintf( reason, sizeof(reason), "overlaps reservation %d", conflicts[i].existing );
+		else if( conflicts[i].incoming >= 0 )
+			snprintf( reason, sizeof(reason), "overlaps record %d", recnos[conflicts[i].incoming] );
+		else if( conflicts[i].series >= 0 )
+			snprintf( reason, sizeof(reason), "overlaps series %d", conflicts[i].series );
+		else
+			continue;
+		skip( out, recnos[i], reason );
+	}
+	fprintf( out, "ok\t%d\n", added );
+	if( added )
+		ctx->changes++;
+
+	free( text );		// REQ4
+	free( incoming );	// REQ4
+	free( recnos );		// REQ4
+	free( conflicts );	// REQ4
+	return 0;
+}
+
+static int cmd_import( batchContext* ctx, char** fields, int count, FILE* out )
+{
+	if( count != 2 )
+		return fail( ctx, out, "usage: import|file" );
+	return crr_batch_import( ctx, fields[1], out );
+}
+
+typedef int (*batchCommand)( batchContext* ctx, char** fields, int count, FILE* out );
+
+static const struct {
+	const char* name;
+	batchCommand run;
+} COMMANDS[] = {
+	{ "reserve", cmd_reserve },
+	{ "free", cmd_free },
+	{ "day", cmd_day },
+	{ "range", cmd_range },
+	{ "slots", cmd_slots },
+	{ "room", cmd_room },
+	{ "desc", cmd_desc },
+	{ "word", cmd_word },
+	{ "update", cmd_update },
+	{ "delete", cmd_delete },
+	{ "repeat", cmd_repeat },
+	{ "series", cmd_series },
+	{ "occurrences", cmd_occurrences },
+	{ "skip", cmd_skip },
+	{ "unrepeat", cmd_unrepeat },
+	{ "import", cmd_import }
+};
+
+/***
+ * Runs one command line, writing its answer to out. The line is cut up in
+ * place. Returns 0, or -1 if the command failed or hit a conflict. Blank
+ * and comment lines produce no output.
+ */
+int crr_batch_line( batchContext* ctx, char* line, FILE* out )
+{
+	char* fields[BATCH_MAX_FIELDS];
+
+	line[strcspn( line, "\r\n" )] = '\0';
+	line = trim( line );
+	if( !*line || *line == '#' )
+		return 0;
+
+	int count = split_fields( line, fields );
+	for( size_t i = 0; i < sizeof(COMMANDS) / sizeof(COMMANDS[0]); i++ )
+	{
+		if( strcasecmp( fields[0], COMMANDS[i].name ) == 0 )
+		{
+			int result = COMMANDS[i].run( ctx, fields, count, out );
+			resArena_reset( &ctx->scratch );	// Whatever the command took is given back at once
+			return result;
+		}
+	}
+	return fail( ctx, out, "unknown command" );
+}
+
+// Runs every line of in; returns how many commands failed
+int crr_batch_run( batchContext* ctx, FILE* in, FILE* out )
+{
+	char* line = NULL;
+	size_t size = 0;
+	while( getline( &line, &size, in ) != -1 )
+		crr_batch_line( ctx, line, out );
+
+	if( line )
+		free( line );	// REQ4
+	return ctx->failures;
+}
@@ -0,0 +1,63 @@
+#ifndef CRR_BATCH_H
+#define CRR_BATCH_H
+
+/***
+ * Line oriented command language for driving crr without the menus.
+ *
+ * One command per line, fields separated by '|', blank lines and lines
+ * starting with '#' skipped:
+ *
+ *	reserve|room|start|end|description
+ *	free|date						rooms with nothing reserved at date
+ *	day|date[|limit[|offset]]		reservations and occurrences on the day of date
+ *	range|start|end[|limit[|offset]]	reservations and occurrences of any room overlapping start..end
+ *	slots|minutes|start|end[|count[|room,room...]]	earliest free times that long
+ *	room|room[|limit[|offset]]		upcoming reservations of a room
+ *	desc|text[|limit[|offset]]		reservations whose description holds text
+ *	word|word[|limit[|offset]]		reservations with word as a whole word, from the word index
+ *	update|index|room|start|end|description		empty fields keep their value
+ *	delete|index
+ *	repeat|room|start|end|daily/weekly/monthly|interval|count or until|description
+ *	series							every recurring series
+ *	occurrences|start|end			occurrences of any series overlapping start..end
+ *	skip|series|occurrence			leave one occurrence out of a series
+ *	unrepeat|series					delete a series
+ *	import|file						bulk add from CSV or raw schedule.dat records
+ *
+ * Dates take any format date_parse accepts. Every command answers with
+ * tab separated result lines, then one status line:
+ *
+ *	res	index	room	start	end	description
+ *	room	index	name
+ *	slot	room	start	end
+ *	series	index	room	start	end	freq	interval	count	skipped	description
+ *	occ	series	occurrence	room	start	end	description
+ *	skip	record	reason			an import record that was left out
+ *	ok	count | conflict	1 | error	message
+ *
+ * The searches taking a limit answer with at most that many res lines
+ * (or occ lines, which day and range give in start order among them)
+ * after passing over the first offset, and stop searching once they
+ * have them.
+ * A conflict is preceded by the res line of the reservation in the way,
+ * or the occ line of a recurring occurrence.
+ * Indexes are positions in the schedule; a delete moves the last
+ * reservation into the freed position.
+ */
+
+typedef struct Batch_Context {
+	resVect* v;
+	char** rooms;			// Sorted rooms.dat names
+	int numrooms;
+	int changes;			// Commands that changed the schedule
+	int failures;			// Commands answered with conflict or error
+	resArena scratch;		// Search results of the command being run, reset after each one
+} batchContext;
+
+void crr_batch_init( batchContext* ctx, resVect* v, char** rooms, int numrooms );
+void crr_batch_free( batchContext* ctx );
+int crr_batch_line( batchContext* ctx, char* line, FILE* out );
+int crr_batch_import( batchContext* ctx, const char* filename, FILE* out );
+int crr_batch_run( batchContext* ctx, FILE* in, FILE* out );
+
+#endif
@@ -0,0 +1,866 @@
+/***
+ *	Microbenchmarks for the reservation engine
+ *
+ *	For every schedule size asked for, a synthetic rooms.dat and schedule.dat
+ *	are generated and each engine operation is timed call by call. Rooms are
+ *	picked with Zipf popularity, so a few rooms carry most of the schedule the
+ *	way real buildings do. Everything comes from one seeded generator and a
+ *	fixed start date, so two builds run with the same flags do the same work.
+ *
+ *	The report is one tab separated line per size and operation:
+ *
+ *		size	op	calls	ops_per_sec	p50_ns	p99_ns
+ *
+ *	Lines starting with '#' describe the run.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reservation.h"
+#include "res_recur.h"
+#include "res_shard.h"
+#include "res_snapshot.h"
+#include "search_sort_utils.h"
+
+#define FILE_CALLS 3		// Loads and saves are timed this many times
+#define SNAP_READERS 4		// Reader threads querying snapshots while the writer publishes
+#define SNAP_PUBLISHES 10	// Snapshots the writer publishes during the reader run
+#define SHARD_WRITERS 4		// Threads booking into the sharded store at once
+#define DESC_WORDS 10000	// Descriptions end in a number below this, so word searches stay selective
+#define RECUR_OCCURRENCES 120	// Most occurrences of a series the recurrence check expands
+
+static const char* VOCAB[] = { "Board", "meeting", "Standup", "Review", "Lunch", "Interview", "Training", "Planning" };
+#define VOCAB_SIZE (sizeof(VOCAB) / sizeof(VOCAB[0]))
+
+typedef struct Bench_Options {
+	int rooms;
+	long* sizes;
+	int sizecount;
+	int calls;
+	double zipf;			// Popularity exponent; 0 picks rooms uniformly
+	int minduration;		// Minutes
+	int maxduration;
+	int maxgap;				// Most minutes left free between reservations of a room
+	unsigned long seed;
+	char* dir;
+	int keep;				// Leave the generated files behind
+} benchOptions;
+
+typedef struct Bench_Schedule {
+	char** rooms;
+	double* popularity;		// Cumulative Zipf weights, ending at 1
+	time_t* cursors;		// End of the last reservation generated in each room
+	time_t base;			// First start, stored time
+	time_t horizon;			// Queries pick times from base to here
+	reservation* data;
+	long count;
+} benchSchedule;
+
+static unsigned long long rng_state;
+static long* samples;
+
+static void alloc_error( const char* what )	// REQ6
+{
+	fprintf( stderr, "Error allocating memory for %s.\n", what );
+	snprintf( RES_ERROR_STR, BUFF, "Error running the benchmarks. Quitting the program." );
+	exit(1);
+}
+
+// xorshift64*: fast, and the same numbers on every platform, unlike rand()
+static unsigned long long next_random( void )
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+static long random_below( long bound )
+{
+	return (long)(next_random() % (unsigned long long)bound);
+}
+
+static int pick_room( benchSchedule* s, int rooms )
+{
+	double u = (double)(next_random() >> 11) / (double)(1ULL << 53);
+	int low = 0, high = rooms - 1;
+	while( low < high )
+	{
+		int mid = (low + high) / 2;
+		if( s->popularity[mid] < u )
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+static time_t pick_time( benchSchedule* s )
+{
+	return s->base + random_below( s->horizon - s->base + 1 );
+}
+
+static long elapsed_ns( struct timespec* from )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - from->tv_sec) * 1000000000L + (now.tv_nsec - from->tv_nsec);
+}
+
+// Times one call into the sample slot; whatever the call returns is freed outside the timing
+#define TIMED( sample, call ) do { \
+		struct timespec started; \
+		clock_gettime( CLOCK_MONOTONIC, &started ); \
+		call; \
+		(sample) = elapsed_ns( &started ); \
+	} while( 0 )
+
+static void report( long size, const char* op, int calls )
+{
+	long total = 0;
+	for( int i = 0; i < calls; i++ )
+		total += samples[i];
+	qsort( samples, calls, sizeof(long), sort_long );	// REQ5
+
+	double persec = total ? calls * 1e9 / total : 0;
+	printf( "%ld\t%s\t%d\t%.0f\t%ld\t%ld\n", size, op, calls, persec, samples[calls / 2], samples[(calls * 99) / 100] );
+	fflush( stdout );
+}
+
+static reservation random_reservation( benchSchedule* s, int room, time_t start, const benchOptions* o )
+{
+	char desc[DESC_SIZE];
+	time_t length = 60 * (o->minduration + random_below( o->maxduration - o->minduration + 1 ));
+	snprintf( desc, DESC_SIZE, "%s %s %ld", VOCAB[random_below( VOCAB_SIZE )], VOCAB[random_below( VOCAB_SIZE )], random_below( DESC_WORDS ) );
+	return create_reservation( s->rooms[room], start, start + length, desc );
+}
+
+// The next reservation of a room, after a random gap so the schedule has holes to search
+static reservation next_reservation( benchSchedule* s, int room, const benchOptions* o )
+{
+	time_t start = s->cursors[room] + 60 * random_below( o->maxgap + 1 );
+	reservation res = random_reservation( s, room, start, o );
+	s->cursors[room] = res.endtime;
+	return res;
+}
+
+static void generate( benchSchedule* s, long count, const benchOptions* o )
+{
+	s->data = malloc( sizeof(reservation) * (count ? count : 1) );	// REQ4
+	if( !s->data )
+		alloc_error( "the generated schedule" );
+	for( int i = 0; i < o->rooms; i++ )
+		s->cursors[i] = s->base;
+	for( long i = 0; i < count; i++ )
+		s->data[i] = next_reservation( s, pick_room( s, o->rooms ), o );
+	s->count = count;
+
+	// Busy rooms run far ahead; query over the span an average room covers
+	long double span = 0;
+	for( int i = 0; i < o->rooms; i++ )
+		span += s->cursors[i] - s->base;
+	s->horizon = s->base + (time_t)(span / o->rooms) + 3600;
+}
+
+static void write_rooms( benchSchedule* s, const char* filename, int rooms )
+{
+	FILE* fp = fopen( filename, "w" );
+	if( !fp )	// REQ6
+	{
+		fprintf( stderr, "Cannot open %s for writing: %s\n", filename, strerror( errno ) );
+		exit(1);
+	}
+	for( int i = 0; i < rooms; i++ )
+		fprintf( fp, "%s\n", s->rooms[i] );
+	fclose( fp );
+}
+
+static void load( resVect* v, benchSchedule* s, const benchOptions* o )
+{
+	resVect_init( v );
+	resVect_set_rooms( v, s->rooms, o->rooms );
+}
+
+static void bench_files( benchSchedule* s, long size, const benchOptions* o, char* schedulename )
+{
+	resVect v;
+	int added;
+	resImportConflict* conflicts = malloc( sizeof(resImportConflict) * (s->count ? s->count : 1) );	// REQ4
+	if( !conflicts )
+		alloc_error( "import results" );
+
+	load( &v, s, o );
+	TIMED( samples[0], added = resVect_import( &v, s->data, (int)s->count, conflicts ) );
+	report( size, "import", 1 );
+	free( conflicts );
+	if( added != s->count )
+	{
+		fprintf( stderr, "Generated schedule overlaps itself: %d of %ld imported.\n", added, s->count );
+		exit(1);
+	}
+
+	for( int i = 0; i < FILE_CALLS; i++ )
+		TIMED( samples[i], resVect_write_file( &v, schedulename ) );
+	report( size, "write_file", FILE_CALLS );
+	resVect_free( &v );
+
+	for( int i = 0; i < FILE_CALLS; i++ )
+	{
+		load( &v, s, o );
+		TIMED( samples[i], resVect_read_file( &v, schedulename ) );
+		resVect_free( &v );
+	}
+	report( size, "read_file", FILE_CALLS );
+
+	// Mapping is lazy, so the first index build is part of the cost
+	for( int i = 0; i < FILE_CALLS; i++ )
+	{
+		load( &v, s, o );
+		TIMED( samples[i], resVect_map_file( &v, schedulename ); resVect_need_index( &v ) );
+		resVect_free( &v );
+	}
+	report( size, "map_file", FILE_CALLS );
+}
+
+static void bench_queries( resVect* v, benchSchedule* s, long size, const benchOptions* o )
+{
+	int calls = o->calls;
+	size_t* found;
+	char word[BUFF];
+
+	for( int i = 0; i < calls; i++ )
+	{
+		time_t at = to_local( pick_time( s ) );
+		TIMED( samples[i], found = resVect_select_room_at_time( v, at, s->rooms, o->rooms ) );
+		free( found );
+	}
+	report( size, "room_at_time", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		time_t at = to_local( pick_time( s ) );
+		TIMED( samples[i], found = resVect_select_free_rooms( v, at, at + 3600, s->rooms, o->rooms ) );
+		free( found );
+	}
+	report( size, "free_rooms", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		time_t at = to_local( pick_time( s ) );
+		TIMED( samples[i], found = resVect_select_res_day( v, at ) );
+		free( found );
+	}
+	report( size, "res_day", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		time_t at = to_local( pick_time( s ) );
+		TIMED( samples[i], found = resVect_select_res_range( v, at, at + 3600 ) );
+		free( found );
+	}
+	report( size, "res_range", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		resFreeSlot* slots;
+		time_t at = to_local( pick_time( s ) );
+		TIMED( samples[i], slots = resVect_select_free_slots( v, at, at + 86400, 3600, s->rooms, o->rooms, 5 ) );
+		free( slots );
+	}
+	report( size, "free_slots", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		char* room = s->rooms[pick_room( s, o->rooms )];
+		TIMED( samples[i], found = resVect_select_res_room( v, room ) );
+		free( found );
+	}
+	report( size, "res_room", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		snprintf( word, BUFF, "%ld", random_below( DESC_WORDS ) );
+		TIMED( samples[i], found = resVect_select_res_word( v, word ) );
+		free( found );
+	}
+	report( size, "res_word", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		snprintf( word, BUFF, "%s %ld", VOCAB[random_below( VOCAB_SIZE )], random_below( DESC_WORDS ) );
+		TIMED( samples[i], found = resVect_select_res_desc( v, word ) );
+		free( found );
+	}
+	report( size, "res_desc", calls );
+}
+
+typedef struct Snap_Bench_Reader {
+	benchSchedule* s;
+	int rooms;
+	int calls;
+	int* done;				// Set by the writer once it has published everything
+	unsigned long long rng;	// Each reader has its own generator so the shared one stays reproducible
+	long* samples;
+} snapBenchReader;
+
+static void snap_check_failed( const char* what )
+{
+	fprintf( stderr, "A snapshot reader got a wrong answer from %s.\n", what );
+	exit(1);
+}
+
+/***
+ * Times day and room searches on the current snapshot, alternating, and
+ * checks every answer against the snapshot it came from. Keeps going after
+ * its calls are timed until the writer is done, so every publish and every
+ * snapshot freed happens while readers are inside.
+ */
+static void* snap_reader( void* arg )
+{
+	snapBenchReader* r = (snapBenchReader*)arg;
+	int reader = resSnap_register();
+	if( reader < 0 )
+		snap_check_failed( "resSnap_register" );
+
+	for( int i = 0; i < r->calls || !__atomic_load_n( r->done, __ATOMIC_ACQUIRE ); i++ )
+	{
+		r->rng ^= r->rng >> 12;
+		r->rng ^= r->rng << 25;
+		r->rng ^= r->rng >> 27;
+		unsigned long long pick = r->rng * 2685821657736338717ULL;
+		struct timespec started;
+		clock_gettime( CLOCK_MONOTONIC, &started );
+
+		resSnap* snap = resSnap_enter( reader );
+		int count;
+		if( i % 2 )
+		{
+			char* room = r->s->rooms[pick % r->rooms];
+			size_t* found = resSnap_select_res_room( snap, room, &count );
+			for( int k = 0; k < count; k++ )
+			{
+				if( strcasecmp( resSnap_get( snap, (int)found[k] )->roomname, room ) != 0 )
+					snap_check_failed( "resSnap_select_res_room" );
+			}
+			free( found );
+		} else {
+			time_t at = to_local( r->s->base + (time_t)(pick % (unsigned long long)(r->s->horizon - r->s->base + 1)) );
+			int day = res_local_day( at );
+			size_t* found = resSnap_select_res_day( snap, at, &count );
+			for( int k = 0; k < count; k++ )
+			{
+				if( found[k] >= (size_t)snap->count || snap->startdays[found[k]] > day || snap->enddays[found[k]] < day )
+					snap_check_failed( "resSnap_select_res_day" );
+			}
+			free( found );
+		}
+		resSnap_exit( reader );
+
+		if( i < r->calls )
+			r->samples[i] = elapsed_ns( &started );
+	}
+	resSnap_unregister( reader );
+	return NULL;
+}
+
+// One writer adding and publishing while SNAP_READERS threads search the snapshots
+static void bench_snapshots( resVect* v, benchSchedule* s, long size, const benchOptions* o )
+{
+	snapBenchReader readers[SNAP_READERS];
+	pthread_t threads[SNAP_READERS];
+	int done = 0;
+	int adds = o->calls / SNAP_PUBLISHES + 1;
+
+	resSnap_publish( v );
+	for( int t = 0; t < SNAP_READERS; t++ )
+	{
+		readers[t].s = s;
+		readers[t].rooms = o->rooms;
+		readers[t].calls = o->calls;
+		readers[t].done = &done;
+		readers[t].rng = next_random() | 1;
+		if( !(readers[t].samples = malloc( sizeof(long) * o->calls )) )	// REQ4
+			alloc_error( "the snapshot reader timings" );
+		if( pthread_create( &threads[t], NULL, snap_reader, &readers[t] ) != 0 )	// REQ6
+		{
+			fputs( "Cannot start the snapshot reader threads.\n", stderr );
+			exit(1);
+		}
+	}
+
+	for( int i = 0; i < SNAP_PUBLISHES; i++ )
+	{
+		for( int k = 0; k < adds; k++ )
+			resVect_add( v, next_reservation( s, pick_room( s, o->rooms ), o ) );
+		TIMED( samples[i], resSnap_publish( v ) );
+	}
+	__atomic_store_n( &done, 1, __ATOMIC_RELEASE );
+	for( int t = 0; t < SNAP_READERS; t++ )
+		pthread_join( threads[t], NULL );
+	report( size, "snap_publish", SNAP_PUBLISHES );
+
+	// Every reader's timings together, reported as one operation
+	long* all = malloc( sizeof(long) * o->calls * SNAP_READERS );	// REQ4
+	if( !all )
+		alloc_error( "the snapshot reader timings" );
+	for( int t = 0; t < SNAP_READERS; t++ )
+	{
+		memcpy( all + (size_t)t * o->calls, readers[t].samples, sizeof(long) * o->calls );
+		free( readers[t].samples );
+	}
+	long* own = samples;
+	samples = all;
+	report( size, "snap_read", o->calls * SNAP_READERS );
+	samples = own;
+	free( all );
+	resSnap_free_all();
+}
+
+static void recur_check_failed( const char* what, const resRecur* r, int k )
+{
+	fprintf( stderr, "%s disagrees with the expanded series (%s every %d, %d occurrences, occurrence %d).\n", what, resRecur_freq_name( r->freq ), r->interval, r->count, k );
+	exit(1);
+}
+
+static int days_in_month( int year, int mon )
+{
+	static const int DAYS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	year += 1900;
+	if( mon == 1 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) )
+		return 29;
+	return DAYS[mon];
+}
+
+/***
+ * Occurrence k the slow way: step the first one's local date with mktime,
+ * the way a user would count days, weeks or months on a calendar.
+ */
+static time_t expanded_start( const struct tm* first, int freq, int interval, int k )
+{
+	struct tm tm = *first;
+	if( freq == RECUR_MONTHLY )
+	{
+		int months = first->tm_mon + k * interval;
+		tm.tm_year = first->tm_year + months / 12;
+		tm.tm_mon = months % 12;
+		if( tm.tm_mday > days_in_month( tm.tm_year, tm.tm_mon ) )
+			tm.tm_mday = days_in_month( tm.tm_year, tm.tm_mon );
+	} else {
+		tm.tm_mday += k * interval * (freq == RECUR_WEEKLY ? 7 : 1);
+	}
+	tm.tm_isdst = -1;
+	return to_utc( mktime( &tm ) );	// REQ11
+}
+
+/***
+ * Times resRecur_overlap on random rules and checks every answer, along
+ * with resRecur_start and the count an until date gives, against the
+ * series expanded one occurrence at a time. The rules start on any day of
+ * the month (so monthly ones get clamped), last up to their whole period
+ * and run for years, so they cross clock changes whenever TZ has them.
+ */
+static void bench_recurrences( benchSchedule* s, long size, const benchOptions* o )
+{
+	time_t starts[RECUR_OCCURRENCES];
+	char skipped[RECUR_OCCURRENCES];
+
+	for( int i = 0; i < o->calls; i++ )
+	{
+		int freq = RECUR_DAILY + (int)random_below( 3 );
+		int interval = 1 + (int)random_below( 3 );
+
+		// Away from the small hours, so no occurrence starts in a skipped or repeated hour
+		struct tm first;
+		time_t at = to_local( pick_time( s ) );
+		localtime_r( &at, &first );
+		first.tm_mday = 1 + (int)random_below( 31 );
+		first.tm_hour = 6 + (int)random_below( 16 );
+		first.tm_min = 15 * (int)random_below( 4 );
+		first.tm_isdst = -1;
+		mktime( &first );
+
+		long period = (long)interval * (freq == RECUR_MONTHLY ? 28 : freq == RECUR_WEEKLY ? 7 : 1) * 24 * 60;
+		long minutes = random_below( 2 ) ? o->minduration + random_below( o->maxduration - o->minduration + 1 ) : 1 + random_below( period - 60 );
+		for( int k = 0; k < RECUR_OCCURRENCES; k++ )
+			starts[k] = expanded_start( &first, freq, interval, k );
+		reservation res = random_reservation( s, pick_room( s, o->rooms ), 0, o );
+		res.starttime = starts[0];
+		res.endtime = starts[0] + minutes * 60;
+
+		// Half the rules end by a date somewhere between two occurrences
+		resRecur r;
+		int count = 1 + (int)random_below( RECUR_OCCURRENCES - 1 );
+		time_t until = starts[count - 1] + random_below( starts[count] - starts[count - 1] );
+		int until_rule = (int)random_below( 2 );
+		if( resRecur_init( &r, res, freq, interval, until_rule ? 0 : count, until ) != 0 || r.count != count )
+			recur_check_failed( until_rule ? "The count an until date gives" : "resRecur_init", &r, count );
+		for( int k = 0; k < count; k++ )
+		{
+			if( resRecur_start( &r, k ) != starts[k] )
+				recur_check_failed( "resRecur_start", &r, k );
+		}
+
+		memset( skipped, 0, sizeof(skipped) );
+		for( int n = (int)random_below( 4 ); n > 0; n-- )
+		{
+			int k = (int)random_below( count );
+			skipped[k] = 1;
+			resRecur_skip( &r, k );
+		}
+
+		// Windows touching an occurrence at either end, and windows anywhere around one
+		int k = (int)random_below( count );
+		time_t length = res.endtime - res.starttime;
+		time_t from, to;
+		switch( random_below( 3 ) ) {
+			case 0:
+				from = starts[k] + length;
+				to = from + 1 + random_below( period * 60 );
+				break;
+			case 1:
+				to = starts[k];
+				from = to - 1 - random_below( period * 60 );
+				break;
+			default:
+				from = starts[k] - period * 60 + random_below( period * 120 );
+				to = from + 1 + random_below( period * 60 );
+				break;
+		}
+
+		int found;
+		TIMED( samples[i], found = resRecur_overlap( &r, from, to ) );
+		int expected = -1;
+		for( int j = 0; j < count && expected < 0; j++ )
+		{
+			if( !skipped[j] && starts[j] < to && starts[j] + length > from )
+				expected = j;
+		}
+		if( found != expected )
+			recur_check_failed( "resRecur_overlap", &r, expected );
+	}
+	report( size, "recur_overlap", o->calls );
+}
+
+typedef struct Shard_Bench_Writer {
+	resShards* shards;
+	reservation* adds;		// Generated up front, so the writers share no generator
+	int calls;
+	long* samples;
+} shardBenchWriter;
+
+static void* shard_writer( void* arg )
+{
+	shardBenchWriter* w = (shardBenchWriter*)arg;
+	reservation clash;
+	for( int i = 0; i < w->calls; i++ )
+	{
+		struct timespec started;
+		clock_gettime( CLOCK_MONOTONIC, &started );
+		int conflicted = resShards_add( w->shards, w->adds[i], &clash );
+		w->samples[i] = elapsed_ns( &started );
+		if( conflicted )
+		{
+			fputs( "A generated reservation conflicted in the sharded store.\n", stderr );
+			exit(1);
+		}
+	}
+	return NULL;
+}
+
+/***
+ * SHARD_WRITERS threads booking at once into a store split over shardcount
+ * shards. With one shard every add waits on the same lock, so comparing the
+ * two reports shows what splitting the rooms buys. The store is checked to
+ * hold every reservation afterwards.
+ */
+static void bench_shard_writes( resVect* v, benchSchedule* s, long size, const benchOptions* o, int shardcount, const char* op )
+{
+	shardBenchWriter writers[SHARD_WRITERS];
+	pthread_t threads[SHARD_WRITERS];
+	resShards shards;
+
+	resShards_init( &shards, shardcount, s->rooms, o->rooms );
+	resShards_load( &shards, v );
+
+	// Each generated reservation is past everything its room holds, so none of them conflict
+	long* all = malloc( sizeof(long) * o->calls * SHARD_WRITERS );	// REQ4
+	if( !all )
+		alloc_error( "the shard writer timings" );
+	for( int t = 0; t < SHARD_WRITERS; t++ )
+	{
+		writers[t].shards = &shards;
+		writers[t].calls = o->calls;
+		writers[t].samples = all + (size_t)t * o->calls;
+		if( !(writers[t].adds = malloc( sizeof(reservation) * o->calls )) )	// REQ4
+			alloc_error( "the shard writer reservations" );
+	}
+	for( int i = 0; i < o->calls * SHARD_WRITERS; i++ )
+		writers[i % SHARD_WRITERS].adds[i / SHARD_WRITERS] = next_reservation( s, pick_room( s, o->rooms ), o );
+
+	for( int t = 0; t < SHARD_WRITERS; t++ )
+	{
+		if( pthread_create( &threads[t], NULL, shard_writer, &writers[t] ) != 0 )	// REQ6
+		{
+			fputs( "Cannot start the shard writer threads.\n", stderr );
+			exit(1);
+		}
+	}
+	for( int t = 0; t < SHARD_WRITERS; t++ )
+	{
+		pthread_join( threads[t], NULL );
+		free( writers[t].adds );
+	}
+
+	if( resShards_count( &shards ) != resVect_count( v ) + o->calls * SHARD_WRITERS )
+	{
+		fputs( "The sharded store lost reservations.\n", stderr );
+		exit(1);
+	}
+	long* own = samples;
+	samples = all;
+	report( size, op, o->calls * SHARD_WRITERS );
+	samples = own;
+	free( all );
+	resShards_free( &shards );
+}
+
+static void bench_changes( resVect* v, benchSchedule* s, long size, const benchOptions* o )
+{
+	int calls = o->calls;
+	reservation* clash;
+
+	// Each room's cursor is past everything it holds, so these all go in
+	for( int i = 0; i < calls; i++ )
+	{
+		reservation res = next_reservation( s, pick_room( s, o->rooms ), o );
+		TIMED( samples[i], clash = resVect_add( v, res ) );
+		if( clash )
+		{
+			fputs( "A generated reservation conflicted.\n", stderr );
+			exit(1);
+		}
+	}
+	report( size, "add", calls );
+
+	for( int i = 0; i < calls; i++ )
+	{
+		reservation res = *resVect_get( v, (int)random_below( resVect_count( v ) ) );
+		TIMED( samples[i], clash = resVect_add( v, res ) );
+	}
+	report( size, "add_conflict", calls );
+
+	// Same times and room, new description: never conflicts, but reindexes the words
+	for( int i = 0; i < calls; i++ )
+	{
+		int index = (int)random_below( resVect_count( v ) );
+		reservation res = random_reservation( s, 0, 0, o );
+		reservation old = *resVect_get( v, index );
+		strcpy( old.description, res.description );
+		TIMED( samples[i], clash = resVect_update( v, index, old ) );
+	}
+	report( size, "update", calls );
+
+	int deletes = calls < resVect_count( v ) ? calls : resVect_count( v );
+	for( int i = 0; i < deletes; i++ )
+	{
+		int index = (int)random_below( resVect_count( v ) );
+		TIMED( samples[i], resVect_delete( v, index ) );
+	}
+	if( deletes )
+		report( size, "delete", deletes );
+}
+
+static void bench_size( benchSchedule* s, long size, const benchOptions* o )
+{
+	char roomsname[BUFF];
+	char schedulename[BUFF];
+	resVect v;
+
+	snprintf( roomsname, BUFF, "%s/rooms.dat", o->dir );
+	snprintf( schedulename, BUFF, "%s/schedule.dat", o->dir );
+
+	generate( s, size, o );
+	write_rooms( s, roomsname, o->rooms );
+	bench_files( s, size, o, schedulename );
+	free( s->data );
+	s->data = NULL;
+
+	load( &v, s, o );
+	resVect_read_file( &v, schedulename );
+	bench_queries( &v, s, size, o );
+	bench_snapshots( &v, s, size, o );
+	bench_recurrences( s, size, o );
+	bench_shard_writes( &v, s, size, o, RES_SHARDS_DEFAULT, "shard_add" );
+	bench_shard_writes( &v, s, size, o, 1, "shard_add_1" );
+	bench_changes( &v, s, size, o );
+	resVect_free( &v );
+
+	if( !o->keep )
+	{
+		unlink( roomsname );
+		unlink( schedulename );
+	}
+}
+
+static long* parse_sizes( char* list, int* count )
+{
+	long* sizes = NULL;
+	char* save;
+	*count = 0;
+	for( char* item = strtok_r( list, ",", &save ); item; item = strtok_r( NULL, ",", &save ) )
+	{
+		char* end;
+		long size = strtol( item, &end, 10 );
+		if( *end == 'k' || *end == 'K' )
+			size *= 1000, end++;
+		else if( *end == 'm' || *end == 'M' )
+			size *= 1000000, end++;
+		if( *end || size < 1 || size > 0x7fffffffL )
+			return NULL;
+		sizes = realloc( sizes, sizeof(long) * (*count + 1) );	// REQ4
+		if( !sizes )
+			alloc_error( "the size list" );
+		sizes[(*count)++] = size;
+	}
+	return sizes;
+}
+
+static void print_usage( const char* name )
+{
+	printf( "Usage: %s [--sizes 1k,10k,100k,1m] [--rooms 100] [--calls 1000] [--zipf 1.0] [--duration 15,120]\n", name );
+	puts( "       [--gap 240] [--seed 1] [--dir directory] [--keep]" );
+	puts( "--sizes lists the schedule sizes to generate; 'k' and 'm' mean thousands and millions." );
+	puts( "--zipf sets how strongly popular rooms dominate; 0 spreads reservations evenly." );
+	puts( "--duration is the shortest and longest reservation in minutes, --gap the most free minutes between two." );
+	puts( "--dir is where rooms.dat and schedule.dat are generated (a fresh temporary directory by default)." );
+	puts( "--calls is how many times each operation is timed; loads and saves run 3 times." );
+	puts( "The recurrence check crosses clock changes when TZ names a zone that has them." );
+}
+
+int main( int argc, char** argv )
+{
+	static struct option longopts[] = {
+		{ "sizes", required_argument, NULL, 'n' },
+		{ "rooms", required_argument, NULL, 'r' },
+		{ "calls", required_argument, NULL, 'c' },
+		{ "zipf", required_argument, NULL, 'z' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "gap", required_argument, NULL, 'g' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "dir", required_argument, NULL, 'o' },
+		{ "keep", no_argument, NULL, 'k' },
+		{ NULL, 0, NULL, 0 }
+	};
+	char defaultsizes[] = "1k,10k,100k,1m";
+	char tempdir[] = "/tmp/crr_bench.XXXXXX";
+	benchOptions o = { .rooms = 100, .calls = 1000, .zipf = 1.0, .minduration = 15, .maxduration = 120, .maxgap = 240, .seed = 1 };
+	int opt;
+
+	o.sizes = parse_sizes( defaultsizes, &o.sizecount );
+	while( (opt = getopt_long( argc, argv, "n:r:c:z:d:g:s:o:k", longopts, NULL )) != -1 )
+	{
+		switch( opt ) {
+			case 'n':
+				free( o.sizes );
+				if( !(o.sizes = parse_sizes( optarg, &o.sizecount )) )
+				{
+					print_usage( argv[0] );
+					return 1;
+				}
+				break;
+			case 'r':
+				o.rooms = atoi( optarg );
+				break;
+			case 'c':
+				o.calls = atoi( optarg );
+				break;
+			case 'z':
+				o.zipf = atof( optarg );
+				break;
+			case 'd':
+				if( sscanf( optarg, "%d,%d", &o.minduration, &o.maxduration ) != 2 )
+					o.minduration = o.maxduration = -1;
+				break;
+			case 'g':
+				o.maxgap = atoi( optarg );
+				break;
+			case 's':
+				o.seed = strtoul( optarg, NULL, 10 );
+				break;
+			case 'o':
+				o.dir = optarg;
+				o.keep = 1;
+				break;
+			case 'k':
+				o.keep = 1;
+				break;
+			default:
+				print_usage( argv[0] );
+				return 1;
+		}
+	}
+	if( optind != argc || o.rooms < 1 || o.calls < 1 || o.zipf < 0 || o.minduration < 1 || o.maxduration < o.minduration || o.maxgap < 0 )
+	{
+		print_usage( argv[0] );
+		return 1;
+	}
+	if( !o.dir && !(o.dir = mkdtemp( tempdir )) )	// REQ6
+	{
+		fprintf( stderr, "Cannot create a directory for the generated files: %s\n", strerror( errno ) );
+		return 1;
+	}
+
+	benchSchedule s = { 0 };
+	s.rooms = calloc( o.rooms, sizeof(char*) );				// REQ4
+	s.popularity = malloc( sizeof(double) * o.rooms );		// REQ4
+	s.cursors = malloc( sizeof(time_t) * o.rooms );			// REQ4
+	samples = malloc( sizeof(long) * (o.calls > FILE_CALLS ? o.calls : FILE_CALLS) );	// REQ4
+	if( !s.rooms || !s.popularity || !s.cursors || !samples )
+		alloc_error( "the rooms" );
+
+	// Room names sort in the order crr keeps rooms.dat in
+	double weight = 0;
+	for( int i = 0; i < o.rooms; i++ )
+	{
+		if( !(s.rooms[i] = malloc( ROOM_NAME_LEN )) )	// REQ4
+			alloc_error( "the rooms" );
+		snprintf( s.rooms[i], ROOM_NAME_LEN, "Room%05d", i );
+		s.popularity[i] = weight += 1 / pow( i + 1, o.zipf );
+	}
+	for( int i = 0; i < o.rooms; i++ )
+		s.popularity[i] /= weight;
+	s.popularity[o.rooms - 1] = 1;
+
+	// Monday 2030/01/07 8AM, stored the way schedule.dat stores it
+	struct tm start = { .tm_year = 130, .tm_mon = 0, .tm_mday = 7, .tm_hour = 8, .tm_isdst = -1 };
+	s.base = to_utc( mktime( &start ) );	// REQ11
+
+	printf( "# crr_bench rooms=%d calls=%d zipf=%g duration=%d,%d gap=%d seed=%lu\n", o.rooms, o.calls, o.zipf, o.minduration, o.maxduration, o.maxgap, o.seed );
+	puts( "size\top\tcalls\tops_per_sec\tp50_ns\tp99_ns" );
+	for( int i = 0; i < o.sizecount; i++ )
+	{
+		// Reseeded per size, so adding a size to the list leaves the others' numbers comparable
+		rng_state = o.seed * 0x9E3779B97F4A7C15ULL + (unsigned long long)o.sizes[i];
+		if( !rng_state )
+			rng_state = 1;
+		bench_size( &s, o.sizes[i], &o );
+	}
+
+	if( o.dir == tempdir )
+		rmdir( tempdir );
+	for( int i = 0; i < o.rooms; i++ )
+		free( s.rooms[i] );
+	free( s.rooms );
+	free( s.popularity );
+	free( s.cursors );
+	free( samples );
+	free( o.sizes );
+	return 0;
+}
@@ -0,0 +1,347 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reservation.h"
+#include "res_journal.h"
+#include "crr_batch.h"
+#include "crr_server.h"
+
+#define ERROR_SERVER( op ) fprintf( stderr, "%s:%d (%s): %s\n", __FUNCTION__, __LINE__, op, strerror( errno ) )	// REQ6
+
+typedef struct Server_Client {
+	int fd;
+	char* in;				// Bytes received but not yet a whole line
+	size_t inlen;
+	size_t insize;
+	char* out;				// Answers not yet written
+	size_t outlen;
+	size_t outsize;
+	size_t outsent;
+	int closing;			// Sent all it will; dropped once its answers are out
+	struct Server_Client* prev;
+	struct Server_Client* next;
+} serverClient;
+
+static serverClient* clients = NULL;
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for a client connection.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error serving reservations. Quitting the program." );
+	exit(1);
+}
+
+static void append( char** buff, size_t* len, size_t* size, const char* data, size_t n )
+{
+	if( *len + n > *size )
+	{
+		while( *len + n > *size )
+			*size = *size ? *size * 2 : 4096;
+		*buff = realloc( *buff, *size );	// REQ4
+		if( !*buff )
+			alloc_error();
+	}
+	memcpy( *buff + *len, data, n );
+	*len += n;
+}
+
+static void drop_client( int epfd, serverClient* c )
+{
+	if( c->prev )
+		c->prev->next = c->next;
+	else
+		clients = c->next;
+	if( c->next )
+		c->next->prev = c->prev;
+
+	epoll_ctl( epfd, EPOLL_CTL_DEL, c->fd, NULL );
+	close( c->fd );
+	if( c->in )
+		free( c->in );	// REQ4
+	if( c->out )
+		free( c->out );	// REQ4
+	free( c );			// REQ4
+}
+
+// Non-zero while so many answers wait to go out that the client's further lines must wait too
+static int output_full( serverClient* c )
+{
+	return c->outlen - c->outsent >= SERVER_MAX_PENDING;
+}
+
+static int has_line( serverClient* c )
+{
+	return c->inlen && memchr( c->in, '\n', c->inlen ) != NULL;
+}
+
+// Writes as much pending output as the socket takes; returns -1 if the client is gone
+static int flush_client( int epfd, serverClient* c )
+{
+	while( c->outsent < c->outlen )
+	{
+		ssize_t n = write( c->fd, c->out + c->outsent, c->outlen - c->outsent );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+			break;
+		if( n <= 0 )
+			return -1;
+		c->outsent += n;
+	}
+	if( c->outsent == c->outlen )
+		c->outsent = c->outlen = 0;
+
+	// Only ask for writability while something is waiting to go out, and stop reading while too much is.
+	// Lines held back also keep EPOLLOUT armed, so they run next round even if the client sends nothing more.
+	struct epoll_event ev;
+	ev.events = (c->closing || output_full( c ) ? 0 : EPOLLIN) | (c->outlen || has_line( c ) ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+	epoll_ctl( epfd, EPOLL_CTL_MOD, c->fd, &ev );
+	return 0;
+}
+
+static void save( batchContext* ctx, resJournal* journal, char* schedulename, FILE* out )
+{
+	if( resJournal_checkpoint( journal, ctx->v, schedulename, 1 ) )
+	{
+		ctx->changes = 0;
+		fputs( "ok\t0\n", out );
+	} else {
+		fputs( "error\tcould not save the schedule\n", out );
+	}
+}
+
+// Runs the whole lines the client has sent, queueing the answers, until too many answers are waiting
+static void run_lines( batchContext* ctx, serverClient* c, resJournal* journal, char* schedulename )
+{
+	char* answer = NULL;
+	size_t answerlen = 0;
+	FILE* out = open_memstream( &answer, &answerlen );
+	if( !out )
+		alloc_error();
+
+	size_t start = 0;
+	for( size_t i = 0; i < c->inlen; i++ )
+	{
+		if( c->in[i] != '\n' )
+			continue;
+		c->in[i] = '\0';
+		char* line = c->in + start;
+		if( strcmp( line, "save" ) == 0 || strcmp( line, "save\r" ) == 0 )
+			save( ctx, journal, schedulename, out );
+		else
+			crr_batch_line( ctx, line, out );
+		start = i + 1;
+
+		// The rest waits in c->in until the client has read enough of its answers
+		if( c->outlen - c->outsent + ftell( out ) >= SERVER_MAX_PENDING )
+			break;
+	}
+	memmove( c->in, c->in + start, c->inlen - start );
+	c->inlen -= start;
+
+	fclose( out );
+	append( &c->out, &c->outlen, &c->outsize, answer, answerlen );
+	free( answer );	// REQ4
+}
+
+// Reads what the client sent, up to SERVER_READ_BUDGET so others get their turn; returns -1 when it should be dropped
+static int read_client( batchContext* ctx, serverClient* c, resJournal* journal, char* schedulename )
+{
+	char buff[BUFF * 16];
+	size_t budget = SERVER_READ_BUDGET;
+	while( budget && !output_full( c ) )
+	{
+		ssize_t n = read( c->fd, buff, sizeof(buff) < budget ? sizeof(buff) : budget );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+			return 0;
+		if( n <= 0 )
+			return -1;
+
+		budget -= n;
+		append( &c->in, &c->inlen, &c->insize, buff, n );
+		run_lines( ctx, c, journal, schedulename );
+		if( c->inlen > SERVER_MAX_LINE && !has_line( c ) )
+			return -1;
+	}
+	// Whatever is left is still readable, so epoll reports it again next round
+	return 0;
+}
+
+// Non-zero if the socket at addr has a server behind it; a socket nobody answers on was left by one that died
+static int socket_live( struct sockaddr_un* addr )
+{
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+	if( fd < 0 )
+		return 1;
+	int live = connect( fd, (struct sockaddr*)addr, sizeof(*addr) ) == 0 || errno != ECONNREFUSED;
+	close( fd );
+	return live;
+}
+
+static int listen_on( const char* socketpath )
+{
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if( strlen( socketpath ) >= sizeof(addr.sun_path) )
+	{
+		fprintf( stderr, "%s:%d: Socket path %s is too long.\n", __FUNCTION__, __LINE__, socketpath );
+		return -1;
+	}
+	strcpy( addr.sun_path, socketpath );
+
+	int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+	if( fd < 0 )
+	{
+		ERROR_SERVER( "socket" );
+		return -1;
+	}
+
+	// A socket file left by a server that died would make bind fail; anything else at the path is left alone
+	struct stat st;
+	if( lstat( socketpath, &st ) == 0 )
+	{
+		if( !S_ISSOCK( st.st_mode ) || socket_live( &addr ) )	// REQ6
+		{
+			fprintf( stderr, "%s:%d: %s %s.\n", __FUNCTION__, __LINE__, socketpath, S_ISSOCK( st.st_mode ) ? "is already serving" : "exists and is not a socket" );
+			close( fd );
+			return -1;
+		}
+		unlink( socketpath );
+	}
+	if( bind( fd, (struct sockaddr*)&addr, sizeof(addr) ) != 0 )
+	{
+		ERROR_SERVER( "bind" );
+		close( fd );
+		return -1;
+	}
+	if( listen( fd, SOMAXCONN ) != 0 )
+	{
+		ERROR_SERVER( "listen" );
+		close( fd );
+		unlink( socketpath );
+		return -1;
+	}
+	return fd;
+}
+
+/***
+ * Serves clients on socketpath until SIGINT or SIGTERM, then saves the
+ * schedule if it changed. Returns 0, or -1 if the server couldn't start.
+ */
+int crr_serve( batchContext* ctx, const char* socketpath, resJournal* journal, char* schedulename )
+{
+	int listenfd = listen_on( socketpath );
+	if( listenfd < 0 )
+		return -1;
+
+	// Stop signals arrive through the event loop so a command is never cut short
+	sigset_t stopsignals;
+	sigemptyset( &stopsignals );
+	sigaddset( &stopsignals, SIGINT );
+	sigaddset( &stopsignals, SIGTERM );
+	sigprocmask( SIG_BLOCK, &stopsignals, NULL );
+	signal( SIGPIPE, SIG_IGN );
+	int sigfd = signalfd( -1, &stopsignals, SFD_NONBLOCK | SFD_CLOEXEC );
+
+	int epfd = epoll_create1( EPOLL_CLOEXEC );
+	if( epfd < 0 || sigfd < 0 )
+	{
+		ERROR_SERVER( "epoll_create1" );
+		close( listenfd );
+		return -1;
+	}
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listenfd;
+	epoll_ctl( epfd, EPOLL_CTL_ADD, listenfd, &ev );
+	ev.data.ptr = &sigfd;
+	epoll_ctl( epfd, EPOLL_CTL_ADD, sigfd, &ev );
+
+	printf( "Serving reservations on %s.\n", socketpath );
+	fflush( stdout );
+
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	int running = 1;
+	while( running )
+	{
+		int ready = epoll_wait( epfd, events, SERVER_MAX_EVENTS, JOURNAL_INTERVAL_MS );
+		if( ready < 0 && errno != EINTR )
+		{
+			ERROR_SERVER( "epoll_wait" );
+			break;
+		}
+
+		for( int i = 0; i < ready; i++ )
+		{
+			if( events[i].data.ptr == &sigfd )
+			{
+				running = 0;
+				continue;
+			}
+			if( events[i].data.ptr == &listenfd )
+			{
+				int fd;
+				while( (fd = accept4( listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC )) >= 0 )
+				{
+					serverClient* c = calloc( 1, sizeof(serverClient) );	// REQ4
+					if( !c )
+						alloc_error();
+					c->fd = fd;
+					c->next = clients;
+					if( clients )
+						clients->prev = c;
+					clients = c;
+					ev.events = EPOLLIN;
+					ev.data.ptr = c;
+					epoll_ctl( epfd, EPOLL_CTL_ADD, fd, &ev );
+				}
+				continue;
+			}
+
+			// Answers still go out to a client that has finished sending
+			serverClient* c = events[i].data.ptr;
+			if( flush_client( epfd, c ) != 0 )
+			{
+				drop_client( epfd, c );
+				continue;
+			}
+			// Lines held back while answers piled up run first, once there is room again
+			if( !output_full( c ) && has_line( c ) )
+				run_lines( ctx, c, journal, schedulename );
+			if( !c->closing && !output_full( c ) && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) )
+				c->closing = read_client( ctx, c, journal, schedulename ) != 0;
+			if( flush_client( epfd, c ) != 0 || (c->closing && c->outlen == 0 && !has_line( c )) )
+				drop_client( epfd, c );
+		}
+
+		// Everything done in this round is made durable together
+		resJournal_sync( journal );
+		resJournal_checkpoint( journal, ctx->v, schedulename, 0 );
+	}
+
+	if( ctx->changes )	// REQ10
+		resJournal_checkpoint( journal, ctx->v, schedulename, 1 );
+
+	while( clients )
+		drop_client( epfd, clients );
+	close( epfd );
+	close( sigfd );
+	close( listenfd );
+	unlink( socketpath );
+	return 0;
+}
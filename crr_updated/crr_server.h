@@ -0,0 +1,29 @@
+#ifndef CRR_SERVER_H
+#define CRR_SERVER_H
+
+/***
+ * Daemon mode: keeps the schedule loaded and answers clients on a Unix
+ * domain socket.
+ *
+ * Clients speak the batch command language of crr_batch.h, one command per
+ * line, and get the same tab separated answers back. One more command,
+ * "save", writes the schedule out right away. A single epoll loop serves
+ * every client, so commands run one at a time against the engine and each
+ * sees the changes of the ones before it. SIGINT or SIGTERM stops the
+ * server, which saves before returning.
+ *
+ * A client that sends faster than it reads its answers is held back: once
+ * SERVER_MAX_PENDING bytes of answers are waiting, its remaining lines are
+ * left unrun and nothing more is read from it until the answers drain.
+ */
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_MAX_LINE 65536		// Clients sending longer lines are dropped
+#define SERVER_MAX_PENDING (1 << 20)	// Unsent answer bytes at which a client's further lines wait
+#define SERVER_READ_BUDGET (1 << 16)	// Most bytes read from one client per wakeup
+
+struct Reservation_Journal;
+
+int crr_serve( batchContext* ctx, const char* socketpath, struct Reservation_Journal* journal, char* schedulename );
+
+#endif
@@ -4,6 +4,7 @@
 #include <string.h>
 
 #include "reservation.h"
+#include "date_parse.h"
 #include "search_sort_utils.h"
 #include "crr_utils.h"
 
@@ -11,6 +12,8 @@
 const char* MAIN_MENU[] = { "What would you like to do today?\n", "1. Create a reservation at a particular time.\n", \
 			 "2. Search all the rooms for one day.\n", "3. Search for one room over all days.\n", \
 			 "4. Search the reservations description for a particular reservation.\n", \
+			 "5. Search all the rooms for reservations between two times.\n", \
+			 "6. Find the earliest free times for a reservation of some length.\n", \
 			 "Press enter to quit.\n" };
 
 void main_menu( void )	// REQ3c
@@ -68,19 +71,13 @@ time_t get_start_time( void )	// REQ3c
 	while( fgets( buf, BUFFLEN, stdin ) )
 	{
 		buf[strlen(buf) - 1] = '\0';
-		err = getdate_r( buf, &tempTM );
-		if( err == 7 || err ==8 )
+		err = date_parse( buf, &tempTM );
+		if( err != 0 )
 		{
 			puts( "Invalid format" );
 			print_format_list();
 			puts( "\nEnter a start date:" );
 			continue;
-		} else if( err != 0 ) {		// REQ6
-			fprintf( stderr, "%s:%d: Error processing %s, with error code /%d/. Please source datemsk.sh\n", __FUNCTION__, __LINE__, buf, err ); 
-			puts( "Error converting date. Exiting program." );
-			puts( "Press enter to quit. . ." );
-			getchar();
-			exit(1);
 		}
 		startTime = mktime( &tempTM );
 		if( startTime < currentTime )
@@ -104,20 +101,14 @@ time_t get_end_time( void )		// REQ3c
 	while( fgets( buf, BUFFLEN, stdin ) )
 	{
 		buf[strlen(buf) - 1] = '\0';
-		err = getdate_r( buf, &tempTM );
-		if( err == 7 || err ==8 )
+		err = date_parse( buf, &tempTM );
+		if( err != 0 )
 		{
 			puts( "Invalid format" );
 			print_format_list();
 			puts( "\nEnter an end date:" );
 			// fflush( stdout );
 			continue;
-		} else if( err != 0 ) {		// REQ6
-			fprintf( stderr, "%s:%d: Error processing %s, with error code /%d/. Please source datemsk.sh\n", __FUNCTION__, __LINE__, buf, err ); 
-			puts( "Error converting date. Exiting program." );
-			puts( "Press enter to quit. . ." );
-			getchar();
-			exit(1);
 		}
 		endTime = mktime( &tempTM );
 		break;
@@ -125,16 +116,17 @@ time_t get_end_time( void )		// REQ3c
 	return endTime;
 }
 
-char* get_desc( void )	// REQ3c
+// The description lives in scratch until it is reset
+char* get_desc( resArena* scratch )	// REQ3c
 {
-	char* buf = calloc( DESC_SIZE, sizeof(char) );	// REQ4
+	char* buf = resArena_calloc( scratch, DESC_SIZE, sizeof(char) );	// REQ4
 	puts( "\nEnter a short description (Limit 128 characters):" );
 	fgets( buf, DESC_SIZE, stdin );
-	buf[strlen(buf) - 1] = '\0';
+	buf[strcspn( buf, "\n" )] = '\0';	// Nothing before buf to step on when input ran out
 	return buf;
 }
 
-reservation new_reservation( char* roomname )
+reservation new_reservation( char* roomname, resArena* scratch )
 {
 	char* desc;
 	time_t startTime = 0;
@@ -154,14 +146,13 @@ reservation new_reservation( char* roomname )
 		
 	}
 
-	desc = get_desc();
+	desc = get_desc( scratch );
 
 	reservation temp = create_reservation( roomname, startTime, endTime, desc );
-	free( desc );	// REQ4
 	return temp;
 }
 
-reservation* crr_update_reservation( char* roomname, resVect* v, int res_pos )
+reservation* crr_update_reservation( char* roomname, resVect* v, int res_pos, resArena* scratch )
 {
 
 	reservation* check = NULL;
@@ -179,26 +170,39 @@ reservation* crr_update_reservation( char* roomname, resVect* v, int res_pos )
 			continue;
 		}
 	}
-	desc = get_desc();
+	desc = get_desc( scratch );
 	reservation res = create_reservation( roomname, startTime, endTime, desc );
-	qsort( v->data, v->count, sizeof(reservation), sort_name_time );	// REQ5
-	check = bsearch( &res, v->data, v->count, sizeof(reservation), bsearch_conflict );	// REQ5, REQ7
 
-	if( check != NULL && check != resVect_get( v, res_pos ) )	// REQ7
-		return check;
-
-
-	reservation* updateres = resVect_get( v, res_pos );
-	update_reservation( updateres, roomname, startTime, endTime, desc );
-	free( desc );	// REQ4
-	return NULL;
+	check = resVect_update( v, res_pos, res );	// REQ7
+	return check;
 }
 
-void crr_print_reservations( resVect* v, size_t* lookups, int lookups_size )	// REQ3c
+// occurrences (or NULL) marks the entries that are series occurrences, as resCursor_fetch fills it
+void crr_print_reservations( resVect* v, size_t* lookups, resOccurrence* occurrences, int lookups_size )	// REQ3c
 {
 	for( int i = 0; i < lookups_size; i++ )
 	{
 		printf( "%i. ", i+1 );
-		res_print_reservation( resVect_get( v, lookups[i] ) );
+		if( occurrences && occurrences[i].series >= 0 )
+		{
+			res_print_reservation( &occurrences[i].res );
+			puts( "\tOne occurrence of a recurring reservation." );
+		} else {
+			res_print_reservation( resVect_get( v, lookups[i] ) );
+		}
+	}
+}
+
+void crr_print_slots( char** roomnames, resFreeSlot* slots, int slots_size )	// REQ3c
+{
+	char buff1[BUFFLEN];
+	char buff2[BUFFLEN];
+	for( int i = 0; i < slots_size; i++ )
+	{
+		ctime_r( &slots[i].start, buff1 );
+		ctime_r( &slots[i].end, buff2 );
+		buff1[strlen(buff1) - 1] = '\0';
+		buff2[strlen(buff2) - 1] = '\0';
+		printf( "%i. The %s is free from: %s to: %s.\n", i+1, roomnames[slots[i].room], buff1, buff2 );
 	}
 }
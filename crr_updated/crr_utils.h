@@ -9,8 +9,10 @@ void main_menu( void );
 void print_format_list( void );
 void print_rooms( char** roomnames, int numRooms, int printNums );
 void crr_print_menu( char** menu, size_t* lookups, int lookups_size, int printNums );
-reservation new_reservation( char* roomname );
-reservation* crr_update_reservation( char* roomname, resVect* v, int res_pos );
-void crr_print_reservations( resVect* v, size_t* lookups, int lookups_size );
+char* get_desc( resArena* scratch );
+reservation new_reservation( char* roomname, resArena* scratch );
+reservation* crr_update_reservation( char* roomname, resVect* v, int res_pos, resArena* scratch );
+void crr_print_reservations( resVect* v, size_t* lookups, resOccurrence* occurrences, int lookups_size );
+void crr_print_slots( char** roomnames, resFreeSlot* slots, int slots_size );
 
 #endif
@@ -0,0 +1,306 @@
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "date_parse.h"
+#include "res_stats.h"
+
+// Kept in the order print_format_list shows them, which was also the order of tfile
+static const char* DATE_FORMATS[] = {
+	"%A",
+	"%A at %I%p",
+	"%A at %I:%M%p",
+	"%d at %I%p",
+	"%d at %I:%M%p",
+	"%Y/%m/%d %I%p",
+	"%Y/%m/%d at %I%p",
+	"%Y/%m/%d %I:%M%p",
+	"%Y/%m/%d at %I:%M%p"
+};
+#define DATE_FORMAT_COUNT (sizeof(DATE_FORMATS) / sizeof(DATE_FORMATS[0]))
+#define DATE_MAX_STEPS 32
+
+static const char* WEEKDAYS[] = { "Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday" };
+
+typedef enum Date_Op {
+	OP_SPACE,		// Zero or more white space
+	OP_CHAR,		// One exact character
+	OP_WEEKDAY,		// %A: full or three letter weekday name, any case
+	OP_YEAR,		// %Y
+	OP_MONTH,		// %m
+	OP_MDAY,		// %d
+	OP_HOUR12,		// %I
+	OP_MINUTE,		// %M
+	OP_AMPM			// %p
+} dateOp;
+
+typedef struct Date_Step {
+	dateOp op;
+	char c;
+} dateStep;
+
+typedef struct Date_Format {
+	dateStep steps[DATE_MAX_STEPS];
+	int count;
+} dateFormat;
+
+static dateFormat formats[DATE_FORMAT_COUNT];
+static pthread_once_t compiled = PTHREAD_ONCE_INIT;
+
+static void compile_formats( void )
+{
+	for( size_t i = 0; i < DATE_FORMAT_COUNT; i++ )
+	{
+		dateFormat* f = &formats[i];
+		f->count = 0;
+		for( const char* p = DATE_FORMATS[i]; *p && f->count < DATE_MAX_STEPS; p++ )
+		{
+			dateStep* step = &f->steps[f->count++];
+			if( isspace( (unsigned char)*p ) )
+			{
+				step->op = OP_SPACE;
+				while( isspace( (unsigned char)p[1] ) )
+					p++;
+				continue;
+			}
+			if( *p != '%' || !p[1] )
+			{
+				step->op = OP_CHAR;
+				step->c = *p;
+				continue;
+			}
+			switch( *++p )
+			{
+				case 'A': step->op = OP_WEEKDAY; break;
+				case 'Y': step->op = OP_YEAR; break;
+				case 'm': step->op = OP_MONTH; break;
+				case 'd': step->op = OP_MDAY; break;
+				case 'I': step->op = OP_HOUR12; break;
+				case 'M': step->op = OP_MINUTE; break;
+				case 'p': step->op = OP_AMPM; break;
+				default:
+					step->op = OP_CHAR;
+					step->c = *p;
+					break;
+			}
+		}
+	}
+}
+
+// Reads a number like strptime: leading white space, at most digits digits, no more than to
+static const char* get_number( const char* s, int from, int to, int digits, int* val )
+{
+	while( isspace( (unsigned char)*s ) )
+		s++;
+	if( *s < '0' || *s > '9' )
+		return NULL;
+
+	*val = 0;
+	do {
+		*val = *val * 10 + (*s++ - '0');
+	} while( --digits > 0 && *val * 10 <= to && *s >= '0' && *s <= '9' );
+
+	return *val < from || *val > to ? NULL : s;
+}
+
+static int weekday_name( const char* s, const char** end )
+{
+	int found = -1;
+	size_t longest = 0;
+	for( int d = 0; d < 7; d++ )
+	{
+		size_t full = strlen( WEEKDAYS[d] );
+		if( full > longest && strncasecmp( s, WEEKDAYS[d], full ) == 0 )
+		{
+			found = d;
+			longest = full;
+		} else if( 3 > longest && strncasecmp( s, WEEKDAYS[d], 3 ) == 0 ) {
+			found = d;
+			longest = 3;
+		}
+	}
+	*end = s + longest;
+	return found;
+}
+
+// Runs one compiled format over the whole text; unset fields stay INT_MIN
+static int match_format( const dateFormat* f, const char* s, struct tm* tm )
+{
+	int val;
+	int hour12 = 0;
+	int pm = 0;
+
+	tm->tm_year = tm->tm_mon = tm->tm_mday = tm->tm_wday = INT_MIN;
+	tm->tm_hour = tm->tm_min = tm->tm_sec = INT_MIN;
+
+	for( int i = 0; i < f->count; i++ )
+	{
+		const dateStep* step = &f->steps[i];
+		switch( step->op )
+		{
+			case OP_SPACE:
+				while( isspace( (unsigned char)*s ) )
+					s++;
+				break;
+			case OP_CHAR:
+				if( *s++ != step->c )
+					return 0;
+				break;
+			case OP_WEEKDAY:
+				tm->tm_wday = weekday_name( s, &s );
+				if( tm->tm_wday < 0 )
+					return 0;
+				break;
+			case OP_YEAR:
+				if( !(s = get_number( s, 0, 9999, 4, &val )) )
+					return 0;
+				tm->tm_year = val - 1900;
+				break;
+			case OP_MONTH:
+				if( !(s = get_number( s, 1, 12, 2, &val )) )
+					return 0;
+				tm->tm_mon = val - 1;
+				break;
+			case OP_MDAY:
+				if( !(s = get_number( s, 1, 31, 2, &val )) )
+					return 0;
+				tm->tm_mday = val;
+				break;
+			case OP_HOUR12:
+				if( !(s = get_number( s, 1, 12, 2, &val )) )
+					return 0;
+				tm->tm_hour = val % 12;
+				hour12 = 1;
+				break;
+			case OP_MINUTE:
+				if( !(s = get_number( s, 0, 59, 2, &val )) )
+					return 0;
+				tm->tm_min = val;
+				break;
+			case OP_AMPM:
+				if( strncasecmp( s, "AM", 2 ) == 0 )
+					pm = 0;
+				else if( strncasecmp( s, "PM", 2 ) == 0 )
+					pm = 1;
+				else
+					return 0;
+				s += 2;
+				break;
+		}
+	}
+	if( hour12 && pm )
+		tm->tm_hour += 12;
+
+	while( isspace( (unsigned char)*s ) )
+		s++;
+	return *s == '\0';
+}
+
+static int days_in_month( int year, int mon )
+{
+	static const int days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+	return days[mon] + (mon == 1 && leap);
+}
+
+/***
+ * Parses text as of the local time now. Returns 0 with result set, or
+ * DATE_NO_MATCH when no format fits and DATE_INVALID when one fits but names
+ * a day that doesn't exist or a time mktime can't represent.
+ */
+int date_parse_at( const char* text, struct tm* result, time_t now )
+{
+	RES_STAT_TIMER( STAT_DATE_PARSE );
+	pthread_once( &compiled, compile_formats );
+
+	// Like getdate_r, white space around the date is ignored
+	while( isspace( (unsigned char)*text ) )
+		text++;
+
+	struct tm tm;
+	size_t i = 0;
+	for( ; i < DATE_FORMAT_COUNT; i++ )
+	{
+		if( match_format( &formats[i], text, &tm ) )
+			break;
+	}
+	if( i == DATE_FORMAT_COUNT )
+	{
+		RES_STAT_FAILED();
+		return DATE_NO_MATCH;
+	}
+
+	struct tm current;
+	localtime_r( &now, &current );
+
+	// A weekday alone is today if it is today, otherwise the next one
+	int mday_ok = 0;
+	if( tm.tm_wday >= 0 && tm.tm_wday <= 6 && tm.tm_year == INT_MIN && tm.tm_mon == INT_MIN && tm.tm_mday == INT_MIN )
+	{
+		tm.tm_year = current.tm_year;
+		tm.tm_mon = current.tm_mon;
+		tm.tm_mday = current.tm_mday + (tm.tm_wday - current.tm_wday + 7) % 7;
+		mday_ok = 1;
+	}
+
+	// No time at all means the current time; a partial one is filled with zeros
+	if( tm.tm_hour == INT_MIN && tm.tm_min == INT_MIN && tm.tm_sec == INT_MIN )
+	{
+		tm.tm_hour = current.tm_hour;
+		tm.tm_min = current.tm_min;
+		tm.tm_sec = current.tm_sec;
+	}
+	if( tm.tm_hour == INT_MIN )
+		tm.tm_hour = 0;
+	if( tm.tm_min == INT_MIN )
+		tm.tm_min = 0;
+	if( tm.tm_sec == INT_MIN )
+		tm.tm_sec = 0;
+
+	if( tm.tm_year == INT_MIN )
+		tm.tm_year = current.tm_year;
+	if( tm.tm_mon == INT_MIN )
+		tm.tm_mon = current.tm_mon;
+
+	tm.tm_isdst = -1;
+	if( (!mday_ok && (tm.tm_mday < 1 || tm.tm_mday > days_in_month( tm.tm_year + 1900, tm.tm_mon ))) || mktime( &tm ) == (time_t)-1 )
+	{
+		RES_STAT_FAILED();
+		return DATE_INVALID;
+	}
+
+	*result = tm;
+	return 0;
+}
+
+int date_parse( const char* text, struct tm* result )
+{
+	return date_parse_at( text, result, time( NULL ) );
+}
+
+/***
+ * Parses count dates against one reading of the clock, so relative dates in
+ * a batch all agree on what today is. times[i] is -1 where texts[i] didn't
+ * parse. Returns how many did.
+ */
+int date_parse_batch( char** texts, int count, time_t* times )
+{
+	time_t now = time( NULL );
+	int parsed = 0;
+	for( int i = 0; i < count; i++ )
+	{
+		struct tm tm;
+		if( date_parse_at( texts[i], &tm, now ) == 0 )
+		{
+			times[i] = mktime( &tm );
+			parsed++;
+		} else {
+			times[i] = -1;
+		}
+	}
+	return parsed;
+}
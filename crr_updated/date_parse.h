@@ -0,0 +1,22 @@
+#ifndef DATE_PARSE_H
+#define DATE_PARSE_H
+
+/***
+ * Built-in replacement for getdate_r and the $DATEMSK template file.
+ *
+ * The formats print_format_list offers are compiled once into small
+ * programs of match steps. Parsing follows getdate_r: the first format
+ * that consumes the whole text wins, fields strptime would leave out are
+ * filled from the current local time, and the result is normalized with
+ * mktime. Nothing is read from the filesystem and no state is shared
+ * between calls once the formats are compiled, so any thread may parse.
+ */
+
+#define DATE_NO_MATCH 7		// Same codes getdate_r returns
+#define DATE_INVALID 8
+
+int date_parse( const char* text, struct tm* result );
+int date_parse_at( const char* text, struct tm* result, time_t now );
+int date_parse_batch( char** texts, int count, time_t* times );
+
+#endif
@@ -1,2 +0,0 @@
-TFILE=$PWD/tfile
-export DATEMSK=$TFILE
@@ -0,0 +1,262 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DESC_MATCH_X86 1
+#endif
+
+#include "reservation.h"
+#include "desc_match.h"
+
+static int verify( const char* desc, size_t pos, const char* key, size_t keylen )
+{
+	return strncasecmp( desc + pos, key, keylen ) == 0;
+}
+
+// Checks candidate positions [from, to) one byte at a time
+static int match_scalar( const char* desc, size_t from, size_t to, const char* key, size_t keylen )
+{
+	unsigned char first = key[0] | 0x20;
+	unsigned char last = key[keylen - 1] | 0x20;
+
+	for( size_t i = from; i < to; i++ )
+	{
+		if( ((unsigned char)desc[i] | 0x20) == first && ((unsigned char)desc[i + keylen - 1] | 0x20) == last && verify( desc, i, key, keylen ) )
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * OR-ing 0x20 folds ASCII upper case onto lower case. It also merges a few
+ * punctuation pairs, but that only lets extra candidates through to verify(),
+ * it never hides a real match.
+ */
+
+typedef int (*match_fn)( const char* desc, size_t positions, const char* key, size_t keylen );
+
+#ifdef DESC_MATCH_X86
+// Checks candidate positions [from, positions); desc is always the start of the field
+static int match_sse2_from( const char* desc, size_t from, size_t positions, const char* key, size_t keylen )
+{
+	const __m128i fold = _mm_set1_epi8( 0x20 );
+	const __m128i first = _mm_set1_epi8( key[0] | 0x20 );
+	const __m128i last = _mm_set1_epi8( key[keylen - 1] | 0x20 );
+
+	// Loads must stay inside the DESC_SIZE field
+	size_t i = from;
+	for( ; i + keylen - 1 + 16 <= DESC_SIZE && i < positions; i += 16 )
+	{
+		__m128i a = _mm_or_si128( _mm_loadu_si128( (const __m128i*)(desc + i) ), fold );
+		__m128i b = _mm_or_si128( _mm_loadu_si128( (const __m128i*)(desc + i + keylen - 1) ), fold );
+		unsigned int mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( a, first ), _mm_cmpeq_epi8( b, last ) ) );
+		while( mask )
+		{
+			size_t pos = i + __builtin_ctz( mask );
+			if( pos >= positions )
+				break;
+			if( verify( desc, pos, key, keylen ) )
+				return 1;
+			mask &= mask - 1;
+		}
+	}
+	return i < positions && match_scalar( desc, i, positions, key, keylen );
+}
+
+static int match_sse2( const char* desc, size_t positions, const char* key, size_t keylen )
+{
+	return match_sse2_from( desc, 0, positions, key, keylen );
+}
+
+__attribute__((target("avx2")))
+static int match_avx2( const char* desc, size_t positions, const char* key, size_t keylen )
+{
+	const __m256i fold = _mm256_set1_epi8( 0x20 );
+	const __m256i first = _mm256_set1_epi8( key[0] | 0x20 );
+	const __m256i last = _mm256_set1_epi8( key[keylen - 1] | 0x20 );
+
+	size_t i = 0;
+	for( ; i + keylen - 1 + 32 <= DESC_SIZE && i < positions; i += 32 )
+	{
+		__m256i a = _mm256_or_si256( _mm256_loadu_si256( (const __m256i*)(desc + i) ), fold );
+		__m256i b = _mm256_or_si256( _mm256_loadu_si256( (const __m256i*)(desc + i + keylen - 1) ), fold );
+		unsigned int mask = _mm256_movemask_epi8( _mm256_and_si256( _mm256_cmpeq_epi8( a, first ), _mm256_cmpeq_epi8( b, last ) ) );
+		while( mask )
+		{
+			size_t pos = i + __builtin_ctz( mask );
+			if( pos >= positions )
+				break;
+			if( verify( desc, pos, key, keylen ) )
+				return 1;
+			mask &= mask - 1;
+		}
+	}
+	return i < positions && match_sse2_from( desc, i, positions, key, keylen );
+}
+#else
+static int match_portable( const char* desc, size_t positions, const char* key, size_t keylen )
+{
+	return match_scalar( desc, 0, positions, key, keylen );
+}
+#endif
+
+static match_fn kernel = NULL;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// Picked once, since snapshot readers may match from several threads at the same time
+static void pick_kernel( void )
+{
+#ifdef DESC_MATCH_X86
+	if( __builtin_cpu_supports( "avx2" ) )
+		kernel = match_avx2;
+	else
+		kernel = match_sse2;
+#else
+	kernel = match_portable;
+#endif
+}
+
+// Non-zero if key occurs in the description field desc, ignoring case
+int desc_match( const char* desc, const char* key, size_t keylen )
+{
+	pthread_once( &kernel_once, pick_kernel );
+
+	if( keylen == 0 )
+		return 1;
+
+	size_t desclen = strnlen( desc, DESC_SIZE );
+	if( keylen > desclen )
+		return 0;
+	return kernel( desc, desclen - keylen + 1, key, keylen );
+}
+
+typedef struct Desc_Scan_Job {
+	const reservation* data;
+	int from;
+	int to;
+	const char* key;
+	size_t keylen;
+	size_t* hits;
+	int count;
+	int size;
+} descScanJob;
+
+static void* scan_range( void* arg )
+{
+	descScanJob* job = (descScanJob*)arg;
+	for( int i = job->from; i < job->to; i++ )
+	{
+		if( !desc_match( job->data[i].description, job->key, job->keylen ) )
+			continue;
+
+		if( job->count == job->size )
+		{
+			job->size = job->size ? job->size * 2 : 5;
+			job->hits = realloc( job->hits, sizeof(size_t) * job->size );	// REQ4
+			if( !job->hits )	// REQ6
+			{
+				fputs( "Error reallocating memory to return reservations for a description search.", stderr );
+				snprintf( RES_ERROR_STR, BUFF, "Error retrieving reservations for a description search. Quitting the program." );
+				exit(1);
+			}
+		}
+		job->hits[job->count++] = i;
+	}
+	return NULL;
+}
+
+/***
+ * Puts the indices of every record whose description contains key into
+ * *hits, in index order, and returns how many there are. *hits holds *size
+ * entries and is grown as needed, so a caller that keeps it between scans
+ * only allocates until it is big enough. Long scans are cut into contiguous
+ * chunks, one per worker thread, and the per-chunk hit lists are stitched
+ * back together in chunk order; only those extra chunks allocate.
+ */
+int desc_scan_into( const reservation* data, int count, const char* key, size_t** hits, int* size )
+{
+	descScanJob jobs[DESC_SCAN_MAX_THREADS];
+	pthread_t threads[DESC_SCAN_MAX_THREADS];
+	int nthreads = 1;
+
+	if( count >= DESC_SCAN_PARALLEL )
+	{
+		long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+		nthreads = cpus < 1 ? 1 : cpus > DESC_SCAN_MAX_THREADS ? DESC_SCAN_MAX_THREADS : cpus;
+	}
+
+	for( int t = 0; t < nthreads; t++ )
+	{
+		jobs[t].data = data;
+		jobs[t].from = (long)count * t / nthreads;
+		jobs[t].to = (long)count * (t + 1) / nthreads;
+		jobs[t].key = key;
+		jobs[t].keylen = strlen( key );
+		jobs[t].hits = NULL;
+		jobs[t].count = 0;
+		jobs[t].size = 0;
+	}
+	jobs[0].hits = *hits;
+	jobs[0].size = *size;
+
+	// The calling thread takes the first chunk itself
+	int started = 1;
+	for( ; started < nthreads; started++ )
+	{
+		if( pthread_create( &threads[started], NULL, scan_range, &jobs[started] ) != 0 )
+			break;
+	}
+	scan_range( &jobs[0] );
+	for( int t = 1; t < nthreads; t++ )
+	{
+		if( t < started )
+			pthread_join( threads[t], NULL );
+		else
+			scan_range( &jobs[t] );		// Couldn't get a thread; do it here
+	}
+
+	size_t* merged = jobs[0].hits;
+	int total = jobs[0].count;
+	for( int t = 1; t < nthreads; t++ )
+	{
+		if( jobs[t].count == 0 )
+			continue;
+		if( total + jobs[t].count > jobs[0].size )
+		{
+			jobs[0].size = total + jobs[t].count;
+			merged = realloc( merged, sizeof(size_t) * jobs[0].size );	// REQ4
+			if( !merged )	// REQ6
+			{
+				fputs( "Error reallocating memory to return reservations for a description search.", stderr );
+				snprintf( RES_ERROR_STR, BUFF, "Error retrieving reservations for a description search. Quitting the program." );
+				exit(1);
+			}
+		}
+		memcpy( merged + total, jobs[t].hits, sizeof(size_t) * jobs[t].count );
+		total += jobs[t].count;
+		free( jobs[t].hits );	// REQ4
+	}
+
+	*hits = merged;
+	*size = jobs[0].size;
+	return total;
+}
+
+// The indices of every record whose description contains key, or NULL if there are none
+size_t* desc_scan( const reservation* data, int count, const char* key, int* hits )
+{
+	size_t* found = NULL;
+	int size = 0;
+	*hits = desc_scan_into( data, count, key, &found, &size );
+	if( *hits == 0 )
+	{
+		free( found );	// REQ4
+		return NULL;
+	}
+	return found;
+}
@@ -0,0 +1,20 @@
+#ifndef DESC_MATCH_H
+#define DESC_MATCH_H
+
+#define DESC_SCAN_PARALLEL 65536	// Scans at least this long are split across threads
+#define DESC_SCAN_MAX_THREADS 8
+
+/***
+ * Case-insensitive substring search over the fixed DESC_SIZE description
+ * fields. Candidate positions are found 32 (AVX2) or 16 (SSE2) at a time by
+ * matching the first and last byte of the key, and only those are verified
+ * with strncasecmp. Machines without either fall back to a scalar loop.
+ */
+
+struct Reservation;
+
+int desc_match( const char* desc, const char* key, size_t keylen );
+size_t* desc_scan( const struct Reservation* data, int count, const char* key, int* hits );
+int desc_scan_into( const struct Reservation* data, int count, const char* key, size_t** hits, int* size );
+
+#endif
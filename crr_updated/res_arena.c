@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "res_arena.h"
+
+static size_t round_up( size_t bytes )
+{
+	return bytes ? (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1) : ARENA_ALIGN;
+}
+
+static arenaBlock* new_block( size_t bytes )
+{
+	size_t size = bytes > ARENA_BLOCK_SIZE ? bytes : ARENA_BLOCK_SIZE;
+	arenaBlock* b = malloc( sizeof(arenaBlock) + size );	// REQ4
+	if( !b )	// REQ6
+	{
+		fputs( "Error allocating scratch memory.", stderr );
+		snprintf( RES_ERROR_STR, BUFF, "Error allocating memory. Quitting the program." );
+		exit(1);
+	}
+	b->next = NULL;
+	b->size = size;
+	return b;
+}
+
+void resArena_init( resArena* a )
+{
+	memset( a, 0, sizeof(resArena) );
+}
+
+void* resArena_alloc( resArena* a, size_t bytes )
+{
+	bytes = round_up( bytes );
+
+	// Blocks kept from before a reset are used again in order; a new one goes in wherever they run short
+	while( !a->current || a->current->size - a->used < bytes )
+	{
+		arenaBlock* next = a->current ? a->current->next : a->first;
+		if( !next || next->size < bytes )
+		{
+			arenaBlock* b = new_block( bytes );
+			b->next = next;
+			if( a->current )
+				a->current->next = b;
+			else
+				a->first = b;
+			next = b;
+		}
+		a->current = next;
+		a->used = 0;
+	}
+
+	void* p = a->current->data + a->used;
+	a->used += bytes;
+	a->last = p;
+	return p;
+}
+
+void* resArena_calloc( resArena* a, size_t count, size_t size )
+{
+	void* p = resArena_alloc( a, count * size );
+	memset( p, 0, count * size );
+	return p;
+}
+
+// Resizes old, which was oldbytes long; the latest allocation grows in place while its block has room
+void* resArena_grow( resArena* a, void* old, size_t oldbytes, size_t bytes )
+{
+	if( old && old == a->last )
+	{
+		size_t start = (char*)old - a->current->data;
+		if( a->current->size - start >= round_up( bytes ) )
+		{
+			a->used = start + round_up( bytes );
+			return old;
+		}
+	}
+
+	void* p = resArena_alloc( a, bytes );
+	if( old )
+		memcpy( p, old, oldbytes < bytes ? oldbytes : bytes );
+	return p;
+}
+
+// Everything allocated so far is given back; the blocks stay for the next command
+void resArena_reset( resArena* a )
+{
+	a->current = a->first;
+	a->used = 0;
+	a->last = NULL;
+}
+
+void resArena_free( resArena* a )	// REQ4
+{
+	while( a->first )
+	{
+		arenaBlock* next = a->first->next;
+		free( a->first );
+		a->first = next;
+	}
+	resArena_init( a );
+}
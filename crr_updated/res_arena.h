@@ -0,0 +1,39 @@
+#ifndef RES_ARENA_H
+#define RES_ARENA_H
+
+#include <stddef.h>
+
+/***
+ * Bump allocator for memory that lives no longer than one command.
+ *
+ * Allocations are cut off the front of a block in order and are never
+ * freed one at a time; resArena_reset gives everything back at once by
+ * pointing the arena at its first block again. Blocks are kept across
+ * resets, so once they are big enough for the biggest command nothing
+ * reaches malloc. Every allocation is aligned for any type.
+ */
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN 16
+
+typedef struct Arena_Block {
+	struct Arena_Block* next;
+	size_t size;			// Bytes in data
+	char data[] __attribute__(( aligned( ARENA_ALIGN ) ));
+} arenaBlock;
+
+typedef struct Reservation_Arena {
+	arenaBlock* first;
+	arenaBlock* current;	// Block allocations come from, NULL until the first one
+	size_t used;			// Bytes of current handed out
+	void* last;				// Latest allocation, which can still grow in place
+} resArena;
+
+void resArena_init( resArena* a );
+void* resArena_alloc( resArena* a, size_t bytes );
+void* resArena_calloc( resArena* a, size_t count, size_t size );
+void* resArena_grow( resArena* a, void* old, size_t oldbytes, size_t bytes );
+void resArena_reset( resArena* a );
+void resArena_free( resArena* a );
+
+#endif
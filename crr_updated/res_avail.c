@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "res_avail.h"
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for the room availability bitmaps.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error indexing room availability. Quitting the program." );
+	exit(1);
+}
+
+// Slot number of t, rounding down for times before the epoch too
+static long slot_of( resAvail* a, time_t t )
+{
+	long s = t / a->granularity;
+	if( t % a->granularity < 0 )
+		s--;
+	return s;
+}
+
+// Rebuilds both bitmaps to cover slots first..first+slots-1 with words per row
+static void relayout( resAvail* a, long first, int slots, int words )
+{
+	availWord* full = calloc( (size_t)slots * words, sizeof(availWord) );		// REQ4
+	availWord* touched = calloc( (size_t)slots * words, sizeof(availWord) );	// REQ4
+	if( !full || !touched )
+		alloc_error();
+
+	for( int row = 0; row < a->slots; row++ )
+	{
+		long s = a->first + row;
+		if( s < first || s >= first + slots )
+			continue;
+		memcpy( full + (s - first) * words, a->full + (size_t)row * a->words, sizeof(availWord) * a->words );
+		memcpy( touched + (s - first) * words, a->touched + (size_t)row * a->words, sizeof(availWord) * a->words );
+	}
+
+	if( a->full )
+		free( a->full );
+	if( a->touched )
+		free( a->touched );
+	a->full = full;
+	a->touched = touched;
+	a->first = first;
+	a->slots = slots;
+	a->words = words;
+}
+
+// Widens the window toward slots lo..hi, leaving slack for the next few marks
+static void cover( resAvail* a, long lo, long hi, int roomid )
+{
+	int words = a->words;
+	if( roomid >= words * AVAIL_WORD_BITS )
+		words = roomid / AVAIL_WORD_BITS + 1;
+
+	long first = a->first;
+	long last = a->first + a->slots - 1;
+	if( a->slots == 0 )
+	{
+		first = lo;
+		last = hi;
+	} else if( a->slots < RES_AVAIL_MAX_SLOTS ) {
+		long slack = a->slots / 2 > 96 ? a->slots / 2 : 96;
+		if( lo < first )
+			first = lo - slack;
+		if( hi > last )
+			last = hi + slack;
+	}
+
+	// Once the window is as big as allowed it stays put, so nothing clipped can reappear in it
+	if( last - first + 1 > RES_AVAIL_MAX_SLOTS )
+	{
+		long oldlast = a->first + a->slots - 1;
+		if( a->slots == 0 )
+			last = first + RES_AVAIL_MAX_SLOTS - 1;
+		if( a->slots && lo < a->first && first < oldlast - RES_AVAIL_MAX_SLOTS + 1 )
+			first = oldlast - RES_AVAIL_MAX_SLOTS + 1;
+		if( a->slots && last > first + RES_AVAIL_MAX_SLOTS - 1 )
+			last = first + RES_AVAIL_MAX_SLOTS - 1;
+	}
+
+	if( first != a->first || last - first + 1 != a->slots || words != a->words )
+		relayout( a, first, (int)(last - first + 1), words );
+	if( lo < a->first || hi >= a->first + a->slots )
+		a->clipped = 1;
+}
+
+void resAvail_init( resAvail* a, int granularity )
+{
+	a->granularity = granularity > 0 ? granularity : RES_AVAIL_GRANULARITY;
+	a->first = 0;
+	a->slots = 0;
+	a->words = 0;
+	a->full = NULL;
+	a->touched = NULL;
+	a->clipped = 0;
+}
+
+void resAvail_free( resAvail* a )	// REQ4
+{
+	if( a->full )
+		free( a->full );
+	if( a->touched )
+		free( a->touched );
+	resAvail_init( a, a->granularity );
+}
+
+// Sets the bits of a reservation held by roomid over [start, end]
+void resAvail_mark( resAvail* a, int roomid, time_t start, time_t end )
+{
+	if( end < start )
+		return;
+
+	long lo = slot_of( a, start );
+	long hi = slot_of( a, end );
+	cover( a, lo, hi, roomid );
+
+	if( lo < a->first )
+		lo = a->first;
+	if( hi > a->first + a->slots - 1 )
+		hi = a->first + a->slots - 1;
+
+	availWord bit = (availWord)1 << (roomid % AVAIL_WORD_BITS);
+	int word = roomid / AVAIL_WORD_BITS;
+	for( long s = lo; s <= hi; s++ )
+	{
+		size_t at = (size_t)(s - a->first) * a->words + word;
+		a->touched[at] |= bit;
+		if( start <= s * a->granularity && end >= (s + 1) * a->granularity - 1 )
+			a->full[at] |= bit;
+	}
+}
+
+/***
+ * Clears the bits of a reservation held by roomid over [start, end]. Its
+ * first and last slot may be shared with neighbouring reservations of the
+ * same room, which the caller has to mark again.
+ */
+void resAvail_clear( resAvail* a, int roomid, time_t start, time_t end )
+{
+	if( end < start || roomid >= a->words * AVAIL_WORD_BITS )
+		return;
+
+	long lo = slot_of( a, start );
+	long hi = slot_of( a, end );
+	if( lo < a->first )
+		lo = a->first;
+	if( hi > a->first + a->slots - 1 )
+		hi = a->first + a->slots - 1;
+
+	availWord bit = (availWord)1 << (roomid % AVAIL_WORD_BITS);
+	int word = roomid / AVAIL_WORD_BITS;
+	for( long s = lo; s <= hi; s++ )
+	{
+		size_t at = (size_t)(s - a->first) * a->words + word;
+		a->touched[at] &= ~bit;
+		a->full[at] &= ~bit;
+	}
+}
+
+// First and last second of the slot holding t
+void resAvail_slot_bounds( resAvail* a, time_t t, time_t* slotstart, time_t* slotend )
+{
+	long s = slot_of( a, t );
+	*slotstart = s * a->granularity;
+	*slotend = (s + 1) * a->granularity - 1;
+}
+
+/***
+ * Fills freebits with the rooms free for all of [start, end] and unsure with
+ * the rooms the bitmaps can't decide, a->words words each. Room ids past
+ * a->words words have never been marked. Returns 0, filling nothing, when
+ * the range reaches outside a window that has clipped reservations.
+ */
+int resAvail_free_between( resAvail* a, time_t start, time_t end, availWord* freebits, availWord* unsure )
+{
+	long lo = slot_of( a, start );
+	long hi = slot_of( a, end );
+	long last = a->first + a->slots - 1;
+
+	if( a->clipped && (lo < a->first || hi > last) )
+		return 0;
+
+	// Outside the window nothing is reserved
+	if( lo < a->first )
+		lo = a->first;
+	if( hi > last )
+		hi = last;
+
+	for( int w = 0; w < a->words; w++ )
+	{
+		freebits[w] = 0;
+		unsure[w] = 0;
+	}
+	for( long s = lo; s <= hi; s++ )
+	{
+		const availWord* touched = a->touched + (size_t)(s - a->first) * a->words;
+		const availWord* full = a->full + (size_t)(s - a->first) * a->words;
+		for( int w = 0; w < a->words; w++ )
+		{
+			freebits[w] |= touched[w];		// Gathers every touched room for now
+			unsure[w] |= full[w];			// Gathers every fully taken room for now
+		}
+	}
+	for( int w = 0; w < a->words; w++ )
+	{
+		availWord touched = freebits[w];
+		availWord full = unsure[w];
+		freebits[w] = ~touched;
+		unsure[w] = touched & ~full;
+	}
+	return 1;
+}
@@ -0,0 +1,48 @@
+#ifndef RES_AVAIL_H
+#define RES_AVAIL_H
+
+/***
+ * Room availability bitmaps.
+ *
+ * Time is cut into slots of RES_AVAIL_GRANULARITY seconds. Each slot has one
+ * bit per room id in two rows: touched (some reservation of the room meets
+ * the slot) and full (one reservation covers the whole slot). A room that is
+ * clear in every touched row of a range is free; one with a full bit is
+ * taken. Only rooms that are touched but never full need an exact look at
+ * their schedule.
+ *
+ * The bitmaps cover a window of slots that grows to take in every marked
+ * reservation, up to RES_AVAIL_MAX_SLOTS. Past that the window stops moving
+ * and reservations are clipped to it; queries reaching outside it then
+ * report that they can't be answered.
+ */
+
+typedef unsigned long availWord;
+
+#define AVAIL_WORD_BITS ((int)(sizeof(availWord) * 8))
+
+#ifndef RES_AVAIL_GRANULARITY
+#define RES_AVAIL_GRANULARITY (15 * 60)
+#endif
+#ifndef RES_AVAIL_MAX_SLOTS
+#define RES_AVAIL_MAX_SLOTS (4 * 366 * 24 * 60 * 60 / RES_AVAIL_GRANULARITY)
+#endif
+
+typedef struct Room_Availability {
+	time_t granularity;
+	long first;				// Number of the slot in row 0, counted from the epoch
+	int slots;
+	int words;				// availWords per row
+	availWord* full;		// slots rows of words
+	availWord* touched;
+	int clipped;			// Set once a reservation didn't fit the window
+} resAvail;
+
+void resAvail_init( resAvail* a, int granularity );
+void resAvail_free( resAvail* a );
+void resAvail_mark( resAvail* a, int roomid, time_t start, time_t end );
+void resAvail_clear( resAvail* a, int roomid, time_t start, time_t end );
+void resAvail_slot_bounds( resAvail* a, time_t t, time_t* slotstart, time_t* slotend );
+int resAvail_free_between( resAvail* a, time_t start, time_t end, availWord* freebits, availWord* unsure );
+
+#endif
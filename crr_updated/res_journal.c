@@ -0,0 +1,234 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reservation.h"
+#include "res_journal.h"
+#include "res_recur.h"
+
+#define JOURNAL_MAGIC 0x43525231	// "CRR1"
+
+#define ERROR_JOURNAL( fp, ...) res_error( fp, __FUNCTION__, __LINE__, __VA_ARGS__ "" )		// REQ6
+
+typedef struct Journal_Record {
+	int magic;
+	int op;
+	union {
+		struct {
+			reservation oldres;
+			reservation newres;
+		};
+		resRecur series;	// JOURNAL_SERIES_* records; fits in the same space
+	};
+} journalRecord;
+
+/***
+ * Opens the journal of schedulename and locks it for this process. Returns
+ * 0, -1 if it can't be opened, or JOURNAL_BUSY if another process holds the
+ * lock, in which case that process owns the schedule and we must not start.
+ */
+int resJournal_open( resJournal* j, const char* schedulename )
+{
+	snprintf( j->filename, sizeof( j->filename ), "%s.journal", schedulename );
+	j->pending = 0;
+	j->records = 0;
+
+	if( (j->fd = open( j->filename, O_RDWR | O_CREAT | O_APPEND, 0644 )) < 0 )	// REQ6
+	{
+		ERROR_JOURNAL( stderr, "open journal" );
+		return -1;
+	}
+
+	// Two processes appending to (and truncating) one journal would wipe each other's records
+	if( flock( j->fd, LOCK_EX | LOCK_NB ) != 0 )	// REQ6
+	{
+		int busy = errno == EWOULDBLOCK;
+		if( !busy )
+			ERROR_JOURNAL( stderr, "lock journal" );
+		close( j->fd );
+		j->fd = -1;
+		return busy ? JOURNAL_BUSY : -1;
+	}
+	return 0;
+}
+
+// Applies every complete record in the journal to v, returning how many were applied
+int resJournal_replay( resJournal* j, resVect* v )
+{
+	journalRecord rec;
+	int applied = 0;
+	int index;
+
+	if( j->fd < 0 )
+		return 0;
+
+	lseek( j->fd, 0, SEEK_SET );
+	while( read( j->fd, &rec, sizeof(rec) ) == sizeof(rec) )
+	{
+		// A torn record at the tail means we crashed mid-append; everything before it stands
+		if( rec.magic != JOURNAL_MAGIC )
+			break;
+
+		switch( rec.op ) {
+			case JOURNAL_ADD:
+				if( !resVect_add( v, rec.newres ) )
+					applied++;
+				break;
+			case JOURNAL_UPDATE:
+				if( (index = resVect_find( v, &rec.oldres )) >= 0 && !resVect_update( v, index, rec.newres ) )
+					applied++;
+				break;
+			case JOURNAL_DELETE:
+				if( (index = resVect_find( v, &rec.oldres )) >= 0 )
+				{
+					resVect_delete( v, index );
+					applied++;
+				}
+				break;
+			case JOURNAL_SERIES_ADD:
+				if( !resVect_add_series( v, &rec.series ) )
+					applied++;
+				break;
+			case JOURNAL_SERIES_UPDATE:
+				// Series are found by their first occurrence, which an update never changes
+				if( (index = resVect_find_series( v, &rec.series.first )) >= 0 )
+				{
+					v->series[index] = rec.series;
+					applied++;
+				}
+				break;
+			case JOURNAL_SERIES_DELETE:
+				if( (index = resVect_find_series( v, &rec.series.first )) >= 0 )
+				{
+					resVect_delete_series( v, index );
+					applied++;
+				}
+				break;
+		}
+		j->records++;
+	}
+
+	// Cut off whatever follows the last good record so new appends start on a record boundary
+	if( ftruncate( j->fd, (off_t)j->records * sizeof(journalRecord) ) != 0 )	// REQ6
+		ERROR_JOURNAL( stderr, "truncate torn journal tail" );
+	return applied;
+}
+
+void resJournal_sync( resJournal* j )
+{
+	if( j->fd < 0 || j->pending == 0 )
+		return;
+
+	if( fdatasync( j->fd ) != 0 )	// REQ6
+		ERROR_JOURNAL( stderr, "fdatasync journal" );
+	j->pending = 0;
+}
+
+static long elapsed_ms( struct timespec* since )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static void journal_append( resJournal* j, journalRecord* rec )
+{
+	rec->magic = JOURNAL_MAGIC;
+	if( write( j->fd, rec, sizeof(*rec) ) != sizeof(*rec) )	// REQ6
+	{
+		ERROR_JOURNAL( stderr, "append to journal" );
+		return;
+	}
+
+	if( j->pending++ == 0 )
+		clock_gettime( CLOCK_MONOTONIC, &j->firstpending );
+	j->records++;
+
+	// Group commit: one fdatasync covers every record written since the last one
+	if( j->pending >= JOURNAL_BATCH || elapsed_ms( &j->firstpending ) >= JOURNAL_INTERVAL_MS )
+		resJournal_sync( j );
+}
+
+void resJournal_log( resJournal* j, int op, const reservation* oldres, const reservation* newres )
+{
+	journalRecord rec;
+
+	if( j->fd < 0 )
+		return;
+
+	memset( &rec, 0, sizeof(rec) );
+	rec.op = op;
+	if( oldres )
+		rec.oldres = *oldres;
+	if( newres )
+		rec.newres = *newres;
+	journal_append( j, &rec );
+}
+
+// Records a whole series; updates and deletes find it again by its first occurrence
+void resJournal_log_series( resJournal* j, int op, const resRecur* series )
+{
+	journalRecord rec;
+
+	if( j->fd < 0 )
+		return;
+
+	memset( &rec, 0, sizeof(rec) );
+	rec.op = op;
+	rec.series = *series;
+	journal_append( j, &rec );
+}
+
+/***
+ * Writes the schedule out and empties the journal once it holds
+ * JOURNAL_CHECKPOINT records, or whenever force is set.
+ * Returns non-zero if a checkpoint was taken. Only callers that never offer
+ * to throw changes away may checkpoint without force: once folded into the
+ * schedule file, changes can't be discarded any more.
+ */
+int resJournal_checkpoint( resJournal* j, resVect* v, char* schedulename, int force )
+{
+	// Without a journal there is nothing to fold in, but a forced save still has to happen
+	if( j->fd < 0 )
+		return force && resVect_write_file( v, schedulename ) == 0;
+	if( !force && j->records < JOURNAL_CHECKPOINT )
+		return 0;
+
+	// The journal is only emptied once the schedule file is safely replaced
+	resJournal_sync( j );
+	if( resVect_write_file( v, schedulename ) != 0 )		// REQ10
+		return 0;
+	resJournal_discard( j );
+	return 1;
+}
+
+void resJournal_discard( resJournal* j )
+{
+	if( j->fd < 0 )
+		return;
+
+	if( ftruncate( j->fd, 0 ) != 0 )	// REQ6
+		ERROR_JOURNAL( stderr, "truncate journal" );
+	j->pending = 0;
+	j->records = 0;
+}
+
+void resJournal_close( resJournal* j )
+{
+	if( j->fd < 0 )
+		return;
+
+	// Don't leave an empty journal lying around next to the schedule
+	struct stat st;
+	resJournal_sync( j );
+	if( fstat( j->fd, &st ) == 0 && st.st_size == 0 )
+		unlink( j->filename );
+	close( j->fd );
+	j->fd = -1;
+}
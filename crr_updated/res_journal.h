@@ -0,0 +1,40 @@
+#ifndef RES_JOURNAL_H
+#define RES_JOURNAL_H
+
+#include <time.h>
+
+#define JOURNAL_BATCH 32				// fdatasync after this many unsynced records...
+#define JOURNAL_INTERVAL_MS 100			// ...or once the oldest unsynced record is this old
+#define JOURNAL_CHECKPOINT 4096			// Fold the journal into the schedule after this many records
+#define JOURNAL_BUSY -2					// resJournal_open: another process has the journal locked
+
+enum journal_op { JOURNAL_ADD = 1, JOURNAL_UPDATE, JOURNAL_DELETE, JOURNAL_SERIES_ADD, JOURNAL_SERIES_UPDATE, JOURNAL_SERIES_DELETE };
+
+/***
+ * Write-ahead journal of schedule changes, kept next to the schedule as
+ * <schedule>.journal. Every add, update and delete is appended as it happens
+ * and records are made durable in groups. On startup the journal is replayed
+ * over the schedule, and a checkpoint folds it back into the schedule file.
+ */
+typedef struct Reservation_Journal {
+	int fd;
+	char filename[1024];
+	int pending;			// Records written but not yet synced
+	int records;			// Records since the last checkpoint
+	struct timespec firstpending;
+} resJournal;
+
+struct Reservation;
+struct Reservation_Vector;
+struct Reservation_Recurrence;
+
+int resJournal_open( resJournal* j, const char* schedulename );
+int resJournal_replay( resJournal* j, struct Reservation_Vector* v );
+void resJournal_log( resJournal* j, int op, const struct Reservation* oldres, const struct Reservation* newres );
+void resJournal_log_series( resJournal* j, int op, const struct Reservation_Recurrence* series );
+void resJournal_sync( resJournal* j );
+int resJournal_checkpoint( resJournal* j, struct Reservation_Vector* v, char* schedulename, int force );
+void resJournal_discard( resJournal* j );
+void resJournal_close( resJournal* j );
+
+#endif
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "search_sort_utils.h"
+#include "reservation.h"
+#include "res_tz.h"
+#include "res_recur.h"
+
+#define DAY_SECONDS (24 * 60 * 60)
+
+static const char* FREQ_NAMES[] = { NULL, "daily", "weekly", "monthly" };
+
+// Days since 1970-01-01 of a proleptic Gregorian date (month 1-12)
+static long days_from_civil( long y, int m, int d )
+{
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days( long z, long* y, int* m, int* d )
+{
+	z += 719468;
+	long era = (z >= 0 ? z : z - 146096) / 146097;
+	long doe = z - era * 146097;
+	long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	long mp = (5 * doy + 2) / 153;
+	*d = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*m = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+static int month_days( long y, int m )
+{
+	static const int DAYS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	if( m == 2 && (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) )
+		return 29;
+	return DAYS[m - 1];
+}
+
+static long floor_div( long a, long b )
+{
+	long q = a / b;
+	return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/***
+ * Stored times are to_utc of what mktime gives, so the wall clock is two
+ * offsets away. Going from the wall clock to an instant looks the offset
+ * up again where the first guess lands, which keeps times near an offset
+ * change on the right side of it.
+ */
+static time_t wall_clock( time_t stored )
+{
+	time_t t = stored + resTz_offset( stored + resTz_offset( stored ) );	// REQ11
+	return t + resTz_offset( t );
+}
+
+static time_t from_wall_clock( time_t wall )
+{
+	time_t t = wall - resTz_offset( wall - resTz_offset( wall ) );	// REQ11
+	return to_utc( t );
+}
+
+// Local day and time of day of the first occurrence
+static void first_local( const resRecur* r, long* day, long* tod )
+{
+	time_t wall = wall_clock( r->first.starttime );
+	*day = floor_div( wall, DAY_SECONDS );
+	*tod = wall - *day * DAY_SECONDS;
+}
+
+// Local day occurrence k falls on
+static long occurrence_day( const resRecur* r, long day0, int k )
+{
+	if( r->freq != RECUR_MONTHLY )
+		return day0 + (long)k * r->interval * (r->freq == RECUR_WEEKLY ? 7 : 1);
+
+	long y;
+	int m, d;
+	civil_from_days( day0, &y, &m, &d );
+	long months = (long)(m - 1) + (long)k * r->interval;
+	y += floor_div( months, 12 );
+	m = (int)(months - floor_div( months, 12 ) * 12) + 1;
+	if( d > month_days( y, m ) )
+		d = month_days( y, m );
+	return days_from_civil( y, m, d );
+}
+
+// Stored start time of occurrence k, whether or not it is skipped
+time_t resRecur_start( const resRecur* r, int k )
+{
+	long day0, tod;
+	first_local( r, &day0, &tod );
+	return from_wall_clock( (time_t)occurrence_day( r, day0, k ) * DAY_SECONDS + tod );
+}
+
+time_t resRecur_end( const resRecur* r, int k )
+{
+	return resRecur_start( r, k ) + (r->first.endtime - r->first.starttime);
+}
+
+int resRecur_skipped( const resRecur* r, int k )
+{
+	return bsearch( &k, r->exceptions, r->exceptioncount, sizeof(int), sort_int ) != NULL;	// REQ5
+}
+
+// Leaves occurrence k out of the series; returns -1 if k is no occurrence or the exception list is full
+int resRecur_skip( resRecur* r, int k )
+{
+	if( k < 0 || k >= r->count || r->exceptioncount == RECUR_MAX_EXCEPTIONS )
+		return -1;
+	if( resRecur_skipped( r, k ) )
+		return 0;
+
+	int i = r->exceptioncount++;
+	for( ; i > 0 && r->exceptions[i - 1] > k; i-- )
+		r->exceptions[i] = r->exceptions[i - 1];
+	r->exceptions[i] = k;
+	return 0;
+}
+
+/***
+ * First occurrence ending after t, skipped or not, or r->count if there is
+ * none. The calendar gives the occurrence number to within a couple, and
+ * the exact one is found by stepping from just below that.
+ */
+int resRecur_first_ending_after( const resRecur* r, time_t t )
+{
+	long day0, tod;
+	first_local( r, &day0, &tod );
+	long day = floor_div( wall_clock( t - (r->first.endtime - r->first.starttime) ), DAY_SECONDS );
+
+	long k;
+	if( r->freq == RECUR_MONTHLY )
+	{
+		long y0, y;
+		int m0, m, d;
+		civil_from_days( day0, &y0, &m0, &d );
+		civil_from_days( day, &y, &m, &d );
+		k = floor_div( (y - y0) * 12 + (m - m0), r->interval );
+	} else {
+		k = floor_div( day - day0, (long)r->interval * (r->freq == RECUR_WEEKLY ? 7 : 1) );
+	}
+	k -= 2;
+	if( k < 0 )
+		k = 0;
+	if( k > r->count )
+		k = r->count;
+
+	while( k < r->count && resRecur_end( r, (int)k ) <= t )
+		k++;
+	return (int)k;
+}
+
+// First occurrence not left out that overlaps [start, end), or -1
+int resRecur_overlap( const resRecur* r, time_t start, time_t end )
+{
+	for( int k = resRecur_first_ending_after( r, start ); k < r->count && resRecur_start( r, k ) < end; k++ )
+	{
+		if( !resRecur_skipped( r, k ) )
+			return k;
+	}
+	return -1;
+}
+
+reservation resRecur_occurrence( const resRecur* r, int k )
+{
+	reservation res = r->first;
+	res.starttime = resRecur_start( r, k );
+	res.endtime = res.starttime + (r->first.endtime - r->first.starttime);
+	return res;
+}
+
+// RECUR_DAILY, RECUR_WEEKLY or RECUR_MONTHLY for a name, or 0
+int resRecur_freq( const char* name )
+{
+	for( int f = RECUR_DAILY; f <= RECUR_MONTHLY; f++ )
+	{
+		if( strcasecmp( name, FREQ_NAMES[f] ) == 0 )
+			return f;
+	}
+	return 0;
+}
+
+const char* resRecur_freq_name( int freq )
+{
+	return freq >= RECUR_DAILY && freq <= RECUR_MONTHLY ? FREQ_NAMES[freq] : "";
+}
+
+/***
+ * Sets up a series starting with first. It ends after count occurrences,
+ * or with the last occurrence starting by until (a stored time) when count
+ * is 0. Returns -1 if the rule is invalid, its occurrences would overlap
+ * each other, or it would be empty or run past RECUR_MAX_COUNT occurrences.
+ */
+int resRecur_init( resRecur* r, reservation first, int freq, int interval, int count, time_t until )
+{
+	memset( r, 0, sizeof(resRecur) );
+	r->first = first;
+	r->freq = freq;
+	r->interval = interval;
+	if( freq < RECUR_DAILY || freq > RECUR_MONTHLY || interval < 1 || first.endtime < first.starttime )
+		return -1;
+
+	// Occurrences may not run into the next one, even across a clock change or a short month
+	long period = (long)interval * (freq == RECUR_MONTHLY ? 28 : freq == RECUR_WEEKLY ? 7 : 1);
+	if( first.endtime - first.starttime > period * DAY_SECONDS - 60 * 60 )
+		return -1;
+
+	if( count == 0 )
+	{
+		// The occurrences starting by until are the ones before the first to end after until plus the length
+		r->count = RECUR_MAX_COUNT + 1;
+		count = resRecur_first_ending_after( r, until + (first.endtime - first.starttime) );
+	}
+	r->count = count;
+	return count >= 1 && count <= RECUR_MAX_COUNT ? 0 : -1;
+}
@@ -0,0 +1,43 @@
+#ifndef RES_RECUR_H
+#define RES_RECUR_H
+
+/***
+ * Recurrence rules: one compact record standing for a whole series of
+ * reservations.
+ *
+ * Occurrence k (counted from 0) starts k * interval days, weeks or months
+ * after the first one, at the same local time of day, and lasts as long as
+ * the first. A monthly series started on the 31st falls on the last day of
+ * shorter months. Occurrences listed in exceptions are left out.
+ *
+ * Nothing is ever expanded ahead of time. The occurrence number near any
+ * instant is worked out from the calendar, so finding what overlaps a
+ * range costs the same however long the series is.
+ */
+
+#define RECUR_MAX_EXCEPTIONS 32
+#define RECUR_MAX_COUNT 3660		// Ten years of daily occurrences
+
+enum recur_freq { RECUR_DAILY = 1, RECUR_WEEKLY, RECUR_MONTHLY };
+
+typedef struct Reservation_Recurrence {
+	reservation first;		// First occurrence, stored times like any reservation
+	int freq;
+	int interval;			// Every interval days, weeks or months
+	int count;				// Occurrences in the series, exceptions included
+	int exceptioncount;
+	int exceptions[RECUR_MAX_EXCEPTIONS];	// Occurrence numbers left out, ascending
+} resRecur;
+
+int resRecur_init( resRecur* r, reservation first, int freq, int interval, int count, time_t until );
+int resRecur_freq( const char* name );
+const char* resRecur_freq_name( int freq );
+time_t resRecur_start( const resRecur* r, int k );
+time_t resRecur_end( const resRecur* r, int k );
+int resRecur_skipped( const resRecur* r, int k );
+int resRecur_skip( resRecur* r, int k );
+int resRecur_first_ending_after( const resRecur* r, time_t t );
+int resRecur_overlap( const resRecur* r, time_t start, time_t end );
+reservation resRecur_occurrence( const resRecur* r, int k );
+
+#endif
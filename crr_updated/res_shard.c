@@ -0,0 +1,447 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "search_sort_utils.h"
+#include "reservation.h"
+#include "res_recur.h"
+#include "res_shard.h"
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for the room shards.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error retrieving reservations. Quitting the program." );
+	exit(1);
+}
+
+// FNV-1a over the lower-cased name, so names differing in case share a shard like they share a room
+static int shard_of( resShards* s, const char* roomname )
+{
+	unsigned int hash = 2166136261u;
+	for( int i = 0; i < ROOM_NAME_LEN && roomname[i]; i++ )
+	{
+		hash ^= (unsigned char)tolower( (unsigned char)roomname[i] );
+		hash *= 16777619u;
+	}
+	return hash % s->count;
+}
+
+/***
+ * Groups the indices of rooms by the shard each room lives in: shard k's
+ * rooms are order[first[k]..first[k+1]), and names[i] is rooms[order[i]],
+ * so a group can be handed to a shard search as a rooms table of its own.
+ */
+static void partition_rooms( resShards* s, char** rooms, int numrooms, int* order, char** names, int* first )
+{
+	int* fill = calloc( s->count, sizeof(int) );	// REQ4
+	if( !fill )
+		alloc_error();
+
+	memset( first, 0, sizeof(int) * (s->count + 1) );
+	for( int i = 0; i < numrooms; i++ )
+		first[shard_of( s, rooms[i] ) + 1]++;
+	for( int k = 0; k < s->count; k++ )
+		first[k + 1] += first[k];
+	for( int i = 0; i < numrooms; i++ )
+	{
+		int k = shard_of( s, rooms[i] );
+		int at = first[k] + fill[k]++;
+		order[at] = i;
+		names[at] = rooms[i];
+	}
+	free( fill );	// REQ4
+}
+
+/***
+ * Sets up count empty shards. rooms is the rooms.dat table (or NULL); every
+ * shard interns all of it so that room ids line up, and it is grouped by
+ * shard once here for the free room searches.
+ */
+void resShards_init( resShards* s, int count, char** rooms, int numrooms )
+{
+	s->count = count > 0 ? count : RES_SHARDS_DEFAULT;
+	s->rooms = rooms;
+	s->numrooms = rooms ? numrooms : 0;
+	s->shards = calloc( s->count, sizeof(resShard) );	// REQ4
+	if( !s->shards )
+		alloc_error();
+
+	for( int i = 0; i < s->count; i++ )
+	{
+		pthread_mutex_init( &s->shards[i].lock, NULL );
+		resVect_init( &s->shards[i].v );
+		if( rooms )
+			resVect_set_rooms( &s->shards[i].v, rooms, numrooms );
+	}
+
+	s->roomorder = malloc( sizeof(int) * (s->numrooms ? s->numrooms : 1) );	// REQ4
+	s->roomgroups = malloc( sizeof(char*) * (s->numrooms ? s->numrooms : 1) );	// REQ4
+	s->roomfirst = malloc( sizeof(int) * (s->count + 1) );	// REQ4
+	if( !s->roomorder || !s->roomgroups || !s->roomfirst )
+		alloc_error();
+	partition_rooms( s, rooms, s->numrooms, s->roomorder, s->roomgroups, s->roomfirst );
+}
+
+// Spreads the reservations and series of v (which can't conflict with each other) over the shards
+void resShards_load( resShards* s, resVect* v )
+{
+	int* sizes = calloc( s->count, sizeof(int) );	// REQ4
+	int* shardof = malloc( sizeof(int) * (v->count ? v->count : 1) );	// REQ4
+	if( !sizes || !shardof )
+		alloc_error();
+	for( int i = 0; i < v->count; i++ )
+	{
+		shardof[i] = shard_of( s, v->data[i].roomname );
+		sizes[shardof[i]]++;
+	}
+
+	for( int k = 0; k < s->count; k++ )
+	{
+		if( !sizes[k] )
+			continue;
+		reservation* bucket = malloc( sizeof(reservation) * sizes[k] );	// REQ4
+		resImportConflict* conflicts = malloc( sizeof(resImportConflict) * sizes[k] );	// REQ4
+		if( !bucket || !conflicts )
+			alloc_error();
+
+		int n = 0;
+		for( int i = 0; i < v->count; i++ )
+		{
+			if( shardof[i] == k )
+				bucket[n++] = v->data[i];
+		}
+		pthread_mutex_lock( &s->shards[k].lock );
+		resVect_import( &s->shards[k].v, bucket, n, conflicts );
+		pthread_mutex_unlock( &s->shards[k].lock );
+		free( bucket );		// REQ4
+		free( conflicts );	// REQ4
+	}
+	free( sizes );		// REQ4
+	free( shardof );	// REQ4
+
+	for( int i = 0; i < v->seriescount; i++ )
+		resShards_add_series( s, &v->series[i], NULL );
+}
+
+void resShards_free( resShards* s )	// REQ4
+{
+	for( int i = 0; i < s->count; i++ )
+	{
+		resVect_free( &s->shards[i].v );
+		pthread_mutex_destroy( &s->shards[i].lock );
+	}
+	free( s->shards );
+	free( s->roomorder );
+	free( s->roomgroups );
+	free( s->roomfirst );
+	s->shards = NULL;
+	s->roomorder = NULL;
+	s->roomgroups = NULL;
+	s->roomfirst = NULL;
+	s->count = 0;
+}
+
+int resShards_count( resShards* s )
+{
+	int total = 0;
+	for( int i = 0; i < s->count; i++ )
+	{
+		pthread_mutex_lock( &s->shards[i].lock );
+		total += resVect_count( &s->shards[i].v );
+		pthread_mutex_unlock( &s->shards[i].lock );
+	}
+	return total;
+}
+
+/***
+ * Adds res unless it overlaps a reservation in its room. Returns 0 when it
+ * was added, or 1 with the reservation in the way copied to *conflict.
+ */
+int resShards_add( resShards* s, reservation res, reservation* conflict )	// REQ7
+{
+	resShard* shard = &s->shards[shard_of( s, res.roomname )];
+
+	pthread_mutex_lock( &shard->lock );
+	reservation* c = resVect_add( &shard->v, res );
+	if( c && conflict )
+		*conflict = *c;
+	pthread_mutex_unlock( &shard->lock );
+	return c != NULL;
+}
+
+/***
+ * Replaces the reservation equal to *old with res. Returns 0 when done, 1
+ * with the reservation in the way copied to *conflict, or -1 if old isn't
+ * stored. A move to a room in another shard holds both locks, taken in
+ * shard order so two such moves can't deadlock.
+ */
+int resShards_update( resShards* s, const reservation* old, reservation res, reservation* conflict )	// REQ7
+{
+	int from = shard_of( s, old->roomname );
+	int to = shard_of( s, res.roomname );
+	resShard* fromshard = &s->shards[from];
+	resShard* toshard = &s->shards[to];
+	int status;
+
+	pthread_mutex_lock( &s->shards[from < to ? from : to].lock );
+	if( from != to )
+		pthread_mutex_lock( &s->shards[from < to ? to : from].lock );
+
+	int index = resVect_find( &fromshard->v, (reservation*)old );
+	if( index < 0 )
+		status = -1;
+	else if( from == to ) {
+		reservation* c = resVect_update( &fromshard->v, index, res );
+		if( c && conflict )
+			*conflict = *c;
+		status = c != NULL;
+	} else {
+		// The old reservation is in another shard, so it can't be the one in the way
+		reservation* c = resVect_add( &toshard->v, res );
+		if( c && conflict )
+			*conflict = *c;
+		if( !c )
+			resVect_delete( &fromshard->v, index );
+		status = c != NULL;
+	}
+
+	if( from != to )
+		pthread_mutex_unlock( &s->shards[from < to ? to : from].lock );
+	pthread_mutex_unlock( &s->shards[from < to ? from : to].lock );
+	return status;
+}
+
+// Deletes the reservation equal to *res; returns 0, or -1 if it isn't stored
+int resShards_delete( resShards* s, const reservation* res )
+{
+	resShard* shard = &s->shards[shard_of( s, res->roomname )];
+
+	pthread_mutex_lock( &shard->lock );
+	int index = resVect_find( &shard->v, (reservation*)res );
+	if( index >= 0 )
+		resVect_delete( &shard->v, index );
+	pthread_mutex_unlock( &shard->lock );
+	return index >= 0 ? 0 : -1;
+}
+
+/***
+ * Adds a recurring series to the shard of its room unless an occurrence
+ * overlaps something there. Returns 0 when it was added, or 1 with the
+ * reservation or occurrence in the way copied to *conflict.
+ */
+int resShards_add_series( resShards* s, resRecur* series, reservation* conflict )	// REQ7
+{
+	resShard* shard = &s->shards[shard_of( s, series->first.roomname )];
+
+	pthread_mutex_lock( &shard->lock );
+	reservation* c = resVect_add_series( &shard->v, series );
+	if( c && conflict )
+		*conflict = *c;
+	pthread_mutex_unlock( &shard->lock );
+	return c != NULL;
+}
+
+// Leaves occurrence k out of the series starting with *first; returns 0, or -1 like resVect_skip_occurrence
+int resShards_skip_occurrence( resShards* s, const reservation* first, int k )
+{
+	resShard* shard = &s->shards[shard_of( s, first->roomname )];
+
+	pthread_mutex_lock( &shard->lock );
+	int status = resVect_skip_occurrence( &shard->v, resVect_find_series( &shard->v, (reservation*)first ), k );
+	pthread_mutex_unlock( &shard->lock );
+	return status;
+}
+
+// Deletes the series starting with *first; returns 0, or -1 if it isn't stored
+int resShards_delete_series( resShards* s, const reservation* first )
+{
+	resShard* shard = &s->shards[shard_of( s, first->roomname )];
+
+	pthread_mutex_lock( &shard->lock );
+	int index = resVect_find_series( &shard->v, (reservation*)first );
+	if( index >= 0 )
+		resVect_delete_series( &shard->v, index );
+	pthread_mutex_unlock( &shard->lock );
+	return index >= 0 ? 0 : -1;
+}
+
+/***
+ * Asks each shard about the rooms that live in it and nobody else: a room
+ * is only ever reserved in its own shard, so that is where its answer comes
+ * from, and the work and lock hold time of a shard stay proportional to its
+ * own rooms. The rooms.dat table is grouped once by resShards_init; any
+ * other rooms table is grouped here. *count gets how many rooms are free.
+ */
+static size_t* shards_free_rooms( resShards* s, time_t start, time_t end, int point, char** rooms, int numrooms, int* count )
+{
+	int* order = s->roomorder;
+	char** names = s->roomgroups;
+	int* first = s->roomfirst;
+	int grouped = rooms == s->rooms && numrooms == s->numrooms;
+
+	if( !grouped )
+	{
+		order = malloc( sizeof(int) * (numrooms ? numrooms : 1) );	// REQ4
+		names = malloc( sizeof(char*) * (numrooms ? numrooms : 1) );	// REQ4
+		first = malloc( sizeof(int) * (s->count + 1) );	// REQ4
+		if( !order || !names || !first )
+			alloc_error();
+		partition_rooms( s, rooms, numrooms, order, names, first );
+	}
+
+	char* freeflag = calloc( numrooms ? numrooms : 1, sizeof(char) );	// REQ4
+	size_t* available = malloc( sizeof(size_t) * (numrooms ? numrooms : 1) );	// REQ4
+	if( !freeflag || !available )
+		alloc_error();
+
+	resQuery q;
+	resQuery_init( &q );
+	for( int k = 0; k < s->count; k++ )
+	{
+		int n = first[k + 1] - first[k];
+		if( !n )
+			continue;
+
+		resShard* shard = &s->shards[k];
+		pthread_mutex_lock( &shard->lock );
+		int found = point ? resVect_query_room_at_time( &shard->v, &q, start, names + first[k], n ) : resVect_query_free_rooms( &shard->v, &q, start, end, names + first[k], n );
+		pthread_mutex_unlock( &shard->lock );
+
+		// Hits index the shard's group; map them back to rooms
+		for( int i = 0; i < found; i++ )
+			freeflag[order[first[k] + q.hits[i]]] = 1;
+	}
+	resQuery_free( &q );
+
+	*count = 0;
+	for( int i = 0; i < numrooms; i++ )
+	{
+		if( freeflag[i] )
+			available[(*count)++] = i;
+	}
+	free( freeflag );	// REQ4
+	if( !grouped )
+	{
+		free( order );	// REQ4
+		free( names );	// REQ4
+		free( first );	// REQ4
+	}
+	return available;
+}
+
+// Same answers as resVect_select_room_at_time: indices into rooms, NULL if no room is reserved
+size_t* resShards_select_room_at_time( resShards* s, time_t key, char** rooms, int numrooms, int* count )
+{
+	size_t* available = shards_free_rooms( s, key, key, 1, rooms, numrooms, count );
+	if( *count == numrooms )
+	{
+		free( available );	// REQ4
+		return NULL;
+	}
+	return available;
+}
+
+// Same answers as resVect_select_free_rooms: indices into rooms, NULL if none is free
+size_t* resShards_select_free_rooms( resShards* s, time_t start, time_t end, char** rooms, int numrooms, int* count )
+{
+	size_t* available = shards_free_rooms( s, start, end, 0, rooms, numrooms, count );
+	if( *count == 0 )
+	{
+		free( available );	// REQ4
+		return NULL;
+	}
+	return available;
+}
+
+// Appends copies of the records a shard search found
+static void collect( resVect* v, size_t* hits, int n, reservation** found, int* count, int* size )
+{
+	if( *count + n > *size )
+	{
+		*size = (*count + n) * 2;
+		*found = realloc( *found, sizeof(reservation) * *size );	// REQ4
+		if( !*found )
+			alloc_error();
+	}
+	for( int i = 0; i < n; i++ )
+		(*found)[(*count)++] = v->data[hits[i]];
+}
+
+// Appends the reservations of the occurrences a shard search found
+static void collect_occurrences( resOccurrence* occurrences, int n, reservation** found, int* count, int* size )
+{
+	if( *count + n > *size )
+	{
+		*size = (*count + n) * 2;
+		*found = realloc( *found, sizeof(reservation) * *size );	// REQ4
+		if( !*found )
+			alloc_error();
+	}
+	for( int i = 0; i < n; i++ )
+		(*found)[(*count)++] = occurrences[i].res;
+}
+
+// Copies of the reservations and series occurrences on the local calendar day holding key, in start order
+reservation* resShards_select_res_day( resShards* s, time_t key, int* count )
+{
+	reservation* found = NULL;
+	int size = 0;
+	resQuery q;
+	resQuery_init( &q );
+
+	*count = 0;
+	for( int k = 0; k < s->count; k++ )
+	{
+		resShard* shard = &s->shards[k];
+		pthread_mutex_lock( &shard->lock );
+		int n = resVect_query_res_day( &shard->v, &q, key );
+		collect( &shard->v, q.hits, n, &found, count, &size );
+		pthread_mutex_unlock( &shard->lock );
+		collect_occurrences( q.occurrences, q.occurrencecount, &found, count, &size );
+	}
+	resQuery_free( &q );
+	qsort( found, *count, sizeof(reservation), sort_res_start );	// REQ5
+	return found;
+}
+
+// Copies of a room's reservations still running or upcoming, in start order; only its shard is asked
+reservation* resShards_select_res_room( resShards* s, const char* key, int* count )
+{
+	resShard* shard = &s->shards[shard_of( s, key )];
+	reservation* found = NULL;
+	int size = 0;
+	char name[ROOM_NAME_LEN];
+
+	strncpy( name, key, ROOM_NAME_LEN - 1 );
+	name[ROOM_NAME_LEN - 1] = '\0';
+	*count = 0;
+	pthread_mutex_lock( &shard->lock );
+	size_t* hits = resVect_select_res_room( &shard->v, name );
+	collect( &shard->v, hits, hits ? res_lookup_size : 0, &found, count, &size );
+	pthread_mutex_unlock( &shard->lock );
+	free( hits );	// REQ4
+	return found;
+}
+
+// Copies of the reservations whose description holds key, in start order
+reservation* resShards_select_res_desc( resShards* s, char* key, int* count )
+{
+	reservation* found = NULL;
+	int size = 0;
+
+	*count = 0;
+	for( int k = 0; k < s->count; k++ )
+	{
+		resShard* shard = &s->shards[k];
+		pthread_mutex_lock( &shard->lock );
+		size_t* hits = resVect_select_res_desc( &shard->v, key );
+		collect( &shard->v, hits, hits ? res_lookup_size : 0, &found, count, &size );
+		pthread_mutex_unlock( &shard->lock );
+		free( hits );	// REQ4
+	}
+	qsort( found, *count, sizeof(reservation), sort_res_start );	// REQ5
+	return found;
+}
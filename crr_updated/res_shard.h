@@ -0,0 +1,58 @@
+#ifndef RES_SHARD_H
+#define RES_SHARD_H
+
+#include <pthread.h>
+
+/***
+ * Reservations split by room over independent shards.
+ *
+ * Two reservations can only conflict in the same room, so each room lives
+ * in exactly one shard (picked by a hash of its name) and a shard is a
+ * resVect of its own behind its own lock. Bookings for rooms in different
+ * shards take different locks and run in parallel. Searches over every
+ * room visit each shard in turn, holding one lock at a time, and merge
+ * what they find; the free room searches ask each shard only about its own
+ * rooms.
+ *
+ * Shard indices move around as reservations are deleted, so this API
+ * hands out copies of records and takes records (rather than indices) to
+ * say which reservation to change. Recurring series live in the shard of
+ * their room too and are named by their first occurrence, as in
+ * resVect_find_series; the free room searches count them and the day search
+ * lists their occurrences.
+ */
+
+#define RES_SHARDS_DEFAULT 16
+
+typedef struct Reservation_Shard {
+	pthread_mutex_t lock;
+	resVect v;
+} resShard;
+
+typedef struct Reservation_Shards {
+	resShard* shards;
+	int count;
+	char** rooms;		// rooms.dat table every shard interns, so room ids agree across shards
+	int numrooms;
+	int* roomorder;		// Indices into rooms grouped by shard; shard k's are roomorder[roomfirst[k]..roomfirst[k+1])
+	char** roomgroups;	// rooms[roomorder[i]], so a shard's group is a rooms table of its own
+	int* roomfirst;
+} resShards;
+
+void resShards_init( resShards* s, int count, char** rooms, int numrooms );
+void resShards_load( resShards* s, resVect* v );
+void resShards_free( resShards* s );
+int resShards_count( resShards* s );
+int resShards_add( resShards* s, reservation res, reservation* conflict );
+int resShards_update( resShards* s, const reservation* old, reservation res, reservation* conflict );
+int resShards_delete( resShards* s, const reservation* res );
+int resShards_add_series( resShards* s, struct Reservation_Recurrence* series, reservation* conflict );
+int resShards_skip_occurrence( resShards* s, const reservation* first, int k );
+int resShards_delete_series( resShards* s, const reservation* first );
+size_t* resShards_select_room_at_time( resShards* s, time_t key, char** rooms, int numrooms, int* count );
+size_t* resShards_select_free_rooms( resShards* s, time_t start, time_t end, char** rooms, int numrooms, int* count );
+reservation* resShards_select_res_day( resShards* s, time_t key, int* count );
+reservation* resShards_select_res_room( resShards* s, const char* key, int* count );
+reservation* resShards_select_res_desc( resShards* s, char* key, int* count );
+
+#endif
@@ -0,0 +1,383 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "desc_match.h"
+#include "res_recur.h"
+#include "res_snapshot.h"
+
+typedef struct Snap_Reader {
+	unsigned long epoch;	// 0 when outside, else the global epoch seen on entering plus one
+	int used;
+	char pad[64 - sizeof(unsigned long) - sizeof(int)];		// One reader per cache line
+} snapReader;
+
+static snapReader readers[SNAP_MAX_READERS];
+static resSnap* current = NULL;
+static unsigned long epoch = 1;
+static resSnap* retired = NULL;		// Only the writer touches the retired list
+static unsigned long versions = 0;
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for a schedule snapshot.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error publishing reservations. Quitting the program." );
+	exit(1);
+}
+
+static void* snap_alloc( size_t count, size_t size )
+{
+	void* p = malloc( (count ? count : 1) * size );	// REQ4
+	if( !p )
+		alloc_error();
+	return p;
+}
+
+static void snap_free( resSnap* s )	// REQ4
+{
+	free( s->data );
+	free( s->roomids );
+	free( s->starts );
+	free( s->ends );
+	free( s->startdays );
+	free( s->enddays );
+	free( s->byroom );
+	free( s->roomfirst );
+	free( s->byday );
+	free( s->daymax );
+	free( s->roomnames );
+	free( s->roomorder );
+	free( s->series );
+	free( s->seriesrooms );
+	free( s );
+}
+
+// Frees every retired snapshot no reader can still be looking at
+static void collect( void )
+{
+	unsigned long oldest = __atomic_load_n( &epoch, __ATOMIC_SEQ_CST );
+	for( int r = 0; r < SNAP_MAX_READERS; r++ )
+	{
+		unsigned long e = __atomic_load_n( &readers[r].epoch, __ATOMIC_SEQ_CST );
+		if( e && e - 1 < oldest )
+			oldest = e - 1;
+	}
+
+	resSnap** link = &retired;
+	while( *link )
+	{
+		resSnap* s = *link;
+		if( s->retired < oldest )
+		{
+			*link = s->nextretired;
+			snap_free( s );
+		} else {
+			link = &s->nextretired;
+		}
+	}
+}
+
+/***
+ * Builds a snapshot of v and makes it the one readers get from now on.
+ * Only the thread changing v may call this. Returns the new snapshot.
+ */
+resSnap* resSnap_publish( resVect* v )
+{
+	resSnap* s = snap_alloc( 1, sizeof(resSnap) );
+	int n = v->count;
+
+	resVect_need_index( v );
+	int* pos = snap_alloc( n, sizeof(int) );
+	s->data = snap_alloc( n, sizeof(reservation) );
+	s->roomids = snap_alloc( n, sizeof(int) );
+	s->starts = snap_alloc( n, sizeof(time_t) );
+	s->ends = snap_alloc( n, sizeof(time_t) );
+	s->startdays = snap_alloc( n, sizeof(int) );
+	s->enddays = snap_alloc( n, sizeof(int) );
+	s->byroom = snap_alloc( n, sizeof(int) );
+	s->byday = snap_alloc( n, sizeof(int) );
+	s->count = n;
+
+	// Walking the timeline gives each slot its position, already in order
+	int p = 0;
+	for( resNode* node = resTree_first( &v->timeline ); node; node = resTree_next( node ), p++ )
+	{
+		int slot = node->slot;
+		pos[slot] = p;
+		s->data[p] = v->data[slot];
+		s->roomids[p] = v->roomids[slot];
+		s->starts[p] = v->starts[slot];
+		s->ends[p] = v->ends[slot];
+		s->startdays[p] = v->startdays[slot];
+		s->enddays[p] = v->enddays[slot];
+	}
+
+	p = 0;
+	for( resNode* node = resTree_first( &v->days ); node; node = resTree_next( node ) )
+		s->byday[p++] = pos[node->slot];
+
+	// Every node of the max tree holds the latest end day under it, like the days tree does
+	for( s->dayleaves = 1; s->dayleaves < n; s->dayleaves *= 2 )
+		;
+	s->daymax = snap_alloc( 2 * s->dayleaves, sizeof(int) );
+	for( int i = 0; i < s->dayleaves; i++ )
+		s->daymax[s->dayleaves + i] = i < n ? s->enddays[s->byday[i]] : INT_MIN;
+	for( int k = s->dayleaves - 1; k > 0; k-- )
+		s->daymax[k] = s->daymax[2 * k] > s->daymax[2 * k + 1] ? s->daymax[2 * k] : s->daymax[2 * k + 1];
+
+	s->roomcount = v->roomcount;
+	s->roomfirst = snap_alloc( v->roomcount + 1, sizeof(int) );
+	s->roomnames = snap_alloc( v->roomcount, sizeof(*s->roomnames) );
+	s->roomorder = snap_alloc( v->roomcount, sizeof(int) );
+	p = 0;
+	for( int r = 0; r < v->roomcount; r++ )
+	{
+		s->roomfirst[r] = p;
+		for( resNode* node = resTree_first( &v->rooms[r].schedule ); node; node = resTree_next( node ) )
+			s->byroom[p++] = pos[node->slot];
+		memcpy( s->roomnames[r], v->rooms[r].roomname, ROOM_NAME_LEN );
+		s->roomorder[r] = v->roomorder[r];
+	}
+	s->roomfirst[v->roomcount] = p;
+	s->internednames = v->roomnames;
+	s->internedrooms = v->internedrooms;
+	free( pos );	// REQ4
+
+	s->seriescount = v->seriescount;
+	s->series = snap_alloc( v->seriescount, sizeof(resRecur) );
+	s->seriesrooms = snap_alloc( v->seriescount, sizeof(int) );
+	if( v->seriescount )
+	{
+		memcpy( s->series, v->series, sizeof(resRecur) * v->seriescount );
+		memcpy( s->seriesrooms, v->seriesrooms, sizeof(int) * v->seriescount );
+	}
+
+	s->version = ++versions;
+	s->nextretired = NULL;
+
+	resSnap* old = __atomic_exchange_n( &current, s, __ATOMIC_SEQ_CST );
+	if( old )
+	{
+		// Readers that could still hold old entered at the present epoch or before
+		old->retired = __atomic_fetch_add( &epoch, 1, __ATOMIC_SEQ_CST );
+		old->nextretired = retired;
+		retired = old;
+	}
+	collect();
+	return s;
+}
+
+// Claims a reader slot for the calling thread; returns -1 if all are taken
+int resSnap_register( void )
+{
+	for( int r = 0; r < SNAP_MAX_READERS; r++ )
+	{
+		int unused = 0;
+		if( __atomic_compare_exchange_n( &readers[r].used, &unused, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST ) )
+			return r;
+	}
+	return -1;
+}
+
+void resSnap_unregister( int reader )
+{
+	__atomic_store_n( &readers[reader].epoch, 0, __ATOMIC_SEQ_CST );
+	__atomic_store_n( &readers[reader].used, 0, __ATOMIC_SEQ_CST );
+}
+
+// The current snapshot, which stays valid until resSnap_exit; NULL before the first publish
+resSnap* resSnap_enter( int reader )
+{
+	__atomic_store_n( &readers[reader].epoch, __atomic_load_n( &epoch, __ATOMIC_SEQ_CST ) + 1, __ATOMIC_SEQ_CST );
+	return __atomic_load_n( &current, __ATOMIC_SEQ_CST );
+}
+
+void resSnap_exit( int reader )
+{
+	__atomic_store_n( &readers[reader].epoch, 0, __ATOMIC_SEQ_CST );
+}
+
+// Frees every snapshot; no reader may be inside
+void resSnap_free_all( void )
+{
+	resSnap* s = __atomic_exchange_n( &current, NULL, __ATOMIC_SEQ_CST );
+	if( s )
+		snap_free( s );
+	while( retired )
+	{
+		s = retired;
+		retired = s->nextretired;
+		snap_free( s );
+	}
+}
+
+reservation* resSnap_get( resSnap* s, int pos )
+{
+	return pos >= 0 && pos < s->count ? &s->data[pos] : NULL;
+}
+
+static int snap_room( resSnap* s, const char* name )
+{
+	int lo = 0;
+	int hi = s->roomcount - 1;
+	while( lo <= hi )
+	{
+		int mid = lo + (hi - lo) / 2;
+		int cmp = strcasecmp( name, s->roomnames[s->roomorder[mid]] );
+		if( cmp == 0 )
+			return s->roomorder[mid];
+		if( cmp < 0 )
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+// First position in a room group whose start comes after t
+static int room_upper_start( resSnap* s, int roomid, time_t t )
+{
+	int lo = s->roomfirst[roomid];
+	int hi = s->roomfirst[roomid + 1];
+	while( lo < hi )
+	{
+		int mid = lo + (hi - lo) / 2;
+		if( s->starts[s->byroom[mid]] <= t )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Same answers as resVect_select_room_at_time: indices into rooms, NULL if no room is reserved
+size_t* resSnap_select_room_at_time( resSnap* s, time_t key, char** rooms, int numrooms, int* count )
+{
+	time_t timekey = to_utc( key );		// REQ11
+	size_t* available = snap_alloc( numrooms, sizeof(size_t) );
+	char* seriesbusy = snap_alloc( s->roomcount, 1 );
+	int reserved = 0;
+
+	// Series are asked once each from their rule, widened a second each way so touching ends count
+	memset( seriesbusy, 0, s->roomcount );
+	for( int i = 0; i < s->seriescount; i++ )
+	{
+		if( resRecur_overlap( &s->series[i], timekey - 1, timekey + 1 ) >= 0 )
+			seriesbusy[s->seriesrooms[i]] = 1;
+	}
+
+	*count = 0;
+	for( int i = 0; i < numrooms; i++ )
+	{
+		int roomid = rooms == s->internednames && i < s->internedrooms ? i : snap_room( s, rooms[i] );
+		int at = roomid >= 0 ? room_upper_start( s, roomid, timekey ) : 0;
+		if( roomid >= 0 && (seriesbusy[roomid] || (at > s->roomfirst[roomid] && timekey <= s->ends[s->byroom[at - 1]])) )
+			reserved++;
+		else
+			available[(*count)++] = i;
+	}
+	free( seriesbusy );	// REQ4
+
+	if( !reserved )
+	{
+		free( available );	// REQ4
+		return NULL;
+	}
+	return available;
+}
+
+typedef struct Snap_Day_Hits {
+	resSnap* s;
+	int day;
+	int upto;				// byday positions from here on start after the day
+	size_t* hits;
+	int count;
+	int size;
+} snapDayHits;
+
+// Collects the byday positions under node k, which covers [lo, lo + width), that end on or after the day
+static void day_hits( snapDayHits* d, int k, int lo, int width )
+{
+	if( lo >= d->upto || d->s->daymax[k] < d->day )
+		return;
+	if( width > 1 )
+	{
+		day_hits( d, 2 * k, lo, width / 2 );
+		day_hits( d, 2 * k + 1, lo + width / 2, width / 2 );
+		return;
+	}
+
+	if( d->count == d->size )
+	{
+		d->size = d->size ? d->size * 2 : 5;
+		d->hits = realloc( d->hits, sizeof(size_t) * d->size );	// REQ4
+		if( !d->hits )
+			alloc_error();
+	}
+	d->hits[d->count++] = d->s->byday[lo];
+}
+
+/***
+ * Same answers as resVect_select_res_day. Everything starting after the day
+ * is cut off by bisection; the max tree then skips every run of byday that
+ * finished before it, so the cost follows the hits, not the days before.
+ */
+size_t* resSnap_select_res_day( resSnap* s, time_t key, int* count )
+{
+	snapDayHits d = { s, res_local_day( key ), 0, NULL, 0, 0 };		// REQ11
+
+	int lo = 0;
+	int hi = s->count;
+	while( lo < hi )
+	{
+		int mid = lo + (hi - lo) / 2;
+		if( s->startdays[s->byday[mid]] <= d.day )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	d.upto = lo;
+
+	day_hits( &d, 1, 0, s->dayleaves );
+	*count = d.count;
+	return d.hits;
+}
+
+// Reservations of a room still running or upcoming, in start order
+size_t* resSnap_select_res_room( resSnap* s, const char* key, int* count )
+{
+	*count = 0;
+	int roomid = snap_room( s, key );
+	if( roomid < 0 )
+		return NULL;
+
+	// Ends rise with starts inside a room, so the first to end after now is found by bisection
+	time_t now = time( NULL );
+	int lo = s->roomfirst[roomid];
+	int hi = s->roomfirst[roomid + 1];
+	int end = hi;
+	while( lo < hi )
+	{
+		int mid = lo + (hi - lo) / 2;
+		if( s->ends[s->byroom[mid]] <= now )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if( lo == end )
+		return NULL;
+
+	size_t* hits = snap_alloc( end - lo, sizeof(size_t) );
+	for( ; lo < end; lo++ )
+		hits[(*count)++] = s->byroom[lo];
+	return hits;
+}
+
+size_t* resSnap_select_res_desc( resSnap* s, const char* key, int* count )
+{
+	return desc_scan( s->data, s->count, key, count );
+}
@@ -0,0 +1,61 @@
+#ifndef RES_SNAPSHOT_H
+#define RES_SNAPSHOT_H
+
+/***
+ * Immutable snapshots of a reservation vector for concurrent readers.
+ *
+ * The one writer keeps changing its resVect as usual and calls
+ * resSnap_publish whenever readers should see the changes. Publishing
+ * flattens the indexes into sorted arrays (a walk of each tree, no sort)
+ * and swaps the new snapshot in with one atomic store, so readers are
+ * never blocked. Reader threads bracket their use of a snapshot with
+ * resSnap_enter and resSnap_exit. A replaced snapshot is freed once every
+ * reader inside when it was replaced has left (epoch based reclamation).
+ *
+ * Query results are positions in the snapshot, read back with
+ * resSnap_get, and their count comes back through *count rather than
+ * res_lookup_size.
+ */
+
+#define SNAP_MAX_READERS 64
+
+typedef struct Reservation_Snapshot {
+	reservation* data;		// Records in timeline order
+	int count;
+	int* roomids;
+	time_t* starts;
+	time_t* ends;
+	int* startdays;
+	int* enddays;
+	int* byroom;			// Positions grouped by room id, each group in start order
+	int* roomfirst;			// Group of room id r is byroom[roomfirst[r]..roomfirst[r+1])
+	int* byday;				// Positions in start day order
+	int* daymax;			// Max tree over byday: node k covers its children 2k and 2k+1, leaves start at dayleaves
+	int dayleaves;			// Leaf count, a power of two at least count
+	char (*roomnames)[ROOM_NAME_LEN];	// By room id
+	int* roomorder;			// Room ids sorted by name
+	int roomcount;
+	char** internednames;	// The rooms.dat table room ids were interned from
+	int internedrooms;
+	struct Reservation_Recurrence* series;	// Recurring series, which only the free room search looks at
+	int* seriesrooms;
+	int seriescount;
+	unsigned long version;
+	unsigned long retired;	// Epoch it was replaced in
+	struct Reservation_Snapshot* nextretired;
+} resSnap;
+
+resSnap* resSnap_publish( resVect* v );
+int resSnap_register( void );
+void resSnap_unregister( int reader );
+resSnap* resSnap_enter( int reader );
+void resSnap_exit( int reader );
+void resSnap_free_all( void );
+
+reservation* resSnap_get( resSnap* s, int pos );
+size_t* resSnap_select_room_at_time( resSnap* s, time_t key, char** rooms, int numrooms, int* count );
+size_t* resSnap_select_res_day( resSnap* s, time_t key, int* count );
+size_t* resSnap_select_res_room( resSnap* s, const char* key, int* count );
+size_t* resSnap_select_res_desc( resSnap* s, const char* key, int* count );
+
+#endif
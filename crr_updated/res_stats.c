@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reservation.h"
+#include "res_stats.h"
+
+#define ERROR_STATS( fp, ...) res_error( fp, __FUNCTION__, __LINE__, __VA_ARGS__ "" )		// REQ6
+
+#define SUB_BITS 3						// 8 buckets per power of two
+#define SUB_COUNT (1 << SUB_BITS)
+#define STAT_BUCKETS ((64 - SUB_BITS) * SUB_COUNT + SUB_COUNT)
+#define STAT_OUT_SIZE 4096
+
+typedef struct Res_Stat {
+	unsigned long failed;
+	unsigned long totalns;
+	unsigned long maxns;
+	unsigned long buckets[STAT_BUCKETS];
+} __attribute__(( aligned( 64 ) )) resStat;
+
+// Output gathered on the stack, for the signal handler's sake
+typedef struct Stat_Out {
+	int fd;
+	int len;
+	char text[STAT_OUT_SIZE];
+} statOut;
+
+static const char* STAT_NAMES[STAT_COUNT] = {
+	"add", "update", "delete", "import", "add_series",
+	"room_at_time", "free_rooms", "res_day", "res_range", "free_slots",
+	"res_room", "res_word", "res_desc", "occurrences",
+	"read_file", "map_file", "write_file", "date_parse"
+};
+
+static resStat stats[STAT_COUNT];
+
+// Values below 16 get a bucket each; above, a power of two is split in 8
+static int bucket_of( unsigned long ns )
+{
+	if( ns < 2 * SUB_COUNT )
+		return (int)ns;
+	int shift = 63 - __builtin_clzl( ns ) - SUB_BITS;
+	return shift * SUB_COUNT + (int)((ns >> shift) & (SUB_COUNT - 1)) + SUB_COUNT;
+}
+
+// Largest latency that falls in bucket b
+static unsigned long bucket_top( int b )
+{
+	if( b < 2 * SUB_COUNT )
+		return b;
+	int shift = (b - SUB_COUNT) / SUB_COUNT;
+	unsigned long sub = (b - SUB_COUNT) % SUB_COUNT + SUB_COUNT;
+	return ((sub + 1) << shift) - 1;
+}
+
+resStatTimer resStats_start( int op )
+{
+	resStatTimer timer = { .op = op };
+	clock_gettime( CLOCK_MONOTONIC, &timer.started );
+	return timer;
+}
+
+void resStats_stop( resStatTimer* timer )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	long ns = (now.tv_sec - timer->started.tv_sec) * 1000000000L + (now.tv_nsec - timer->started.tv_nsec);
+	resStats_record( timer->op, ns > 0 ? (unsigned long)ns : 0, timer->failed );
+}
+
+void resStats_record( int op, unsigned long ns, int failed )
+{
+	resStat* s = &stats[op];
+	if( failed )
+		__atomic_fetch_add( &s->failed, 1, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &s->totalns, ns, __ATOMIC_RELAXED );
+	__atomic_fetch_add( &s->buckets[bucket_of( ns )], 1, __ATOMIC_RELAXED );
+
+	unsigned long max = __atomic_load_n( &s->maxns, __ATOMIC_RELAXED );
+	while( ns > max && !__atomic_compare_exchange_n( &s->maxns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+		;
+}
+
+static void flush_out( statOut* out )
+{
+	int sent = 0;
+	while( sent < out->len )
+	{
+		ssize_t n = write( out->fd, out->text + sent, out->len - sent );
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n <= 0 )
+			break;
+		sent += n;
+	}
+	out->len = 0;
+}
+
+static void put_text( statOut* out, const char* text )
+{
+	for( ; *text; text++ )
+	{
+		if( out->len == STAT_OUT_SIZE )
+			flush_out( out );
+		out->text[out->len++] = *text;
+	}
+}
+
+// snprintf isn't async signal safe, so numbers are formatted by hand
+static void put_number( statOut* out, unsigned long n )
+{
+	char digits[24];
+	int i = sizeof(digits) - 1;
+	digits[i] = '\0';
+	do {
+		digits[--i] = '0' + n % 10;
+		n /= 10;
+	} while( n );
+	put_text( out, digits + i );
+}
+
+// Latency the given thousandths of calls finish within
+static unsigned long percentile( const unsigned long* buckets, unsigned long calls, unsigned long max, int permille )
+{
+	unsigned long rank = (calls * permille + 999) / 1000;
+	unsigned long seen = 0;
+	if( rank == 0 )
+		rank = 1;
+	for( int b = 0; b < STAT_BUCKETS; b++ )
+	{
+		seen += buckets[b];
+		if( seen >= rank )
+			return bucket_top( b ) < max ? bucket_top( b ) : max;
+	}
+	return max;
+}
+
+/***
+ * Writes a tab separated line per entry point that has been called:
+ *
+ *	stat	op	calls	failed	mean_ns	p50_ns	p90_ns	p99_ns	max_ns
+ *
+ * and with buckets set, a line per non-empty histogram bucket:
+ *
+ *	bucket	op	upto_ns	count
+ *
+ * Counters keep moving while they are read, so a dump taken under load
+ * can be off by the calls that finished during it.
+ */
+void resStats_dump( int fd, int buckets )
+{
+	statOut out = { .fd = fd };
+	unsigned long counts[STAT_BUCKETS];
+
+	put_text( &out, "stat\top\tcalls\tfailed\tmean_ns\tp50_ns\tp90_ns\tp99_ns\tmax_ns\n" );
+	for( int op = 0; op < STAT_COUNT; op++ )
+	{
+		resStat* s = &stats[op];
+		unsigned long calls = 0;
+		for( int b = 0; b < STAT_BUCKETS; b++ )
+			calls += counts[b] = __atomic_load_n( &s->buckets[b], __ATOMIC_RELAXED );
+		if( calls == 0 )
+			continue;
+
+		unsigned long max = __atomic_load_n( &s->maxns, __ATOMIC_RELAXED );
+		put_text( &out, "stat\t" );
+		put_text( &out, STAT_NAMES[op] );
+		put_text( &out, "\t" );
+		put_number( &out, calls );
+		put_text( &out, "\t" );
+		put_number( &out, __atomic_load_n( &s->failed, __ATOMIC_RELAXED ) );
+		put_text( &out, "\t" );
+		put_number( &out, __atomic_load_n( &s->totalns, __ATOMIC_RELAXED ) / calls );
+		put_text( &out, "\t" );
+		put_number( &out, percentile( counts, calls, max, 500 ) );
+		put_text( &out, "\t" );
+		put_number( &out, percentile( counts, calls, max, 900 ) );
+		put_text( &out, "\t" );
+		put_number( &out, percentile( counts, calls, max, 990 ) );
+		put_text( &out, "\t" );
+		put_number( &out, max );
+		put_text( &out, "\n" );
+
+		for( int b = 0; buckets && b < STAT_BUCKETS; b++ )
+		{
+			if( counts[b] == 0 )
+				continue;
+			put_text( &out, "bucket\t" );
+			put_text( &out, STAT_NAMES[op] );
+			put_text( &out, "\t" );
+			put_number( &out, bucket_top( b ) );
+			put_text( &out, "\t" );
+			put_number( &out, counts[b] );
+			put_text( &out, "\n" );
+		}
+	}
+	flush_out( &out );
+}
+
+// Writes the counters and full histograms to filename
+int resStats_write_file( const char* filename )
+{
+	int fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if( fd < 0 )	// REQ6
+	{
+		ERROR_STATS( stderr, "open stats file" );
+		return -1;
+	}
+	resStats_dump( fd, 1 );
+	if( close( fd ) != 0 )	// REQ6
+	{
+		ERROR_STATS( stderr, "close stats file" );
+		return -1;
+	}
+	return 0;
+}
+
+static void stats_catcher( int signum )
+{
+	(void)signum;
+	int saved = errno;
+	resStats_dump( STDERR_FILENO, 0 );
+	errno = saved;
+}
+
+// Dumps the counters to stderr whenever signum arrives
+void resStats_install_handler( int signum )
+{
+	struct sigaction act;
+	memset( &act, 0, sizeof(act) );
+	act.sa_handler = stats_catcher;
+	sigfillset( &act.sa_mask );
+
+	// Unlike a curses loop that wants getch() kicked, the menus and batch input should just keep reading
+	act.sa_flags = SA_RESTART;
+
+	if( sigaction( signum, &act, NULL ) )
+	{
+		perror( "sigaction" );
+		exit(1);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef RES_STATS_H
+#define RES_STATS_H
+
+#include <time.h>
+
+/***
+ * Call counters and latency histograms for the engine entry points.
+ *
+ * Every counter is updated with relaxed atomic adds, so any thread can
+ * record without a lock. Latencies go into log-linear buckets in the style
+ * of HDR histograms: 8 buckets per power of two, so a percentile read back
+ * is within 12.5% of the real latency from 1ns up to any time_t. The
+ * dump only reads the counters and writes with write(2), which makes it
+ * safe to run from a signal handler.
+ *
+ * An entry point starts RES_STAT_TIMER( op ) as its first statement. The
+ * timer records when the function returns, whichever return that is, and
+ * RES_STAT_FAILED() marks the call as a conflict or error.
+ */
+
+enum res_stat {
+	STAT_ADD,
+	STAT_UPDATE,
+	STAT_DELETE,
+	STAT_IMPORT,
+	STAT_ADD_SERIES,
+	STAT_ROOM_AT_TIME,
+	STAT_FREE_ROOMS,
+	STAT_RES_DAY,
+	STAT_RES_RANGE,
+	STAT_FREE_SLOTS,
+	STAT_RES_ROOM,
+	STAT_RES_WORD,
+	STAT_RES_DESC,
+	STAT_OCCURRENCES,
+	STAT_READ_FILE,
+	STAT_MAP_FILE,
+	STAT_WRITE_FILE,
+	STAT_DATE_PARSE,
+	STAT_COUNT
+};
+
+typedef struct Res_Stat_Timer {
+	int op;
+	int failed;
+	struct timespec started;
+} resStatTimer;
+
+#define RES_STAT_TIMER( op ) resStatTimer statTimer __attribute__(( cleanup( resStats_stop ) )) = resStats_start( op )
+#define RES_STAT_FAILED() (statTimer.failed = 1)
+
+resStatTimer resStats_start( int op );
+void resStats_stop( resStatTimer* timer );
+void resStats_record( int op, unsigned long ns, int failed );
+void resStats_dump( int fd, int buckets );
+int resStats_write_file( const char* filename );
+void resStats_install_handler( int signum );
+
+#endif
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+
+#include "res_tree.h"
+
+static int node_height( resNode* n )
+{
+	return n ? n->height : 0;
+}
+
+static void node_update( resTree* t, resNode* n )
+{
+	int lh = node_height( n->left );
+	int rh = node_height( n->right );
+	n->height = 1 + ( lh > rh ? lh : rh );
+
+	if( t->end )
+	{
+		n->maxend = t->end( t->ctx, n->slot );
+		if( n->left && n->left->maxend > n->maxend )
+			n->maxend = n->left->maxend;
+		if( n->right && n->right->maxend > n->maxend )
+			n->maxend = n->right->maxend;
+	}
+}
+
+static void replace_child( resTree* t, resNode* parent, resNode* oldchild, resNode* newchild )
+{
+	if( !parent )
+		t->root = newchild;
+	else if( parent->left == oldchild )
+		parent->left = newchild;
+	else
+		parent->right = newchild;
+
+	if( newchild )
+		newchild->parent = parent;
+}
+
+static resNode* rotate_left( resTree* t, resNode* x )
+{
+	resNode* y = x->right;
+	x->right = y->left;
+	if( y->left )
+		y->left->parent = x;
+	replace_child( t, x->parent, x, y );
+	y->left = x;
+	x->parent = y;
+	node_update( t, x );
+	node_update( t, y );
+	return y;
+}
+
+static resNode* rotate_right( resTree* t, resNode* x )
+{
+	resNode* y = x->left;
+	x->left = y->right;
+	if( y->right )
+		y->right->parent = x;
+	replace_child( t, x->parent, x, y );
+	y->right = x;
+	x->parent = y;
+	node_update( t, x );
+	node_update( t, y );
+	return y;
+}
+
+// Walks from n up to the root fixing heights and rotating where needed
+static void rebalance( resTree* t, resNode* n )
+{
+	while( n )
+	{
+		node_update( t, n );
+		int balance = node_height( n->left ) - node_height( n->right );
+		if( balance > 1 )
+		{
+			if( node_height( n->left->left ) < node_height( n->left->right ) )
+				rotate_left( t, n->left );
+			n = rotate_right( t, n );
+		} else if( balance < -1 ) {
+			if( node_height( n->right->right ) < node_height( n->right->left ) )
+				rotate_right( t, n->right );
+			n = rotate_left( t, n );
+		}
+		n = n->parent;
+	}
+}
+
+void resTree_init( resTree* t, resTree_cmp cmp, const void* ctx )
+{
+	t->root = NULL;
+	t->count = 0;
+	t->cmp = cmp;
+	t->end = NULL;
+	t->ctx = ctx;
+}
+
+// Has every node keep the latest end time below it; call while the tree is empty
+void resTree_augment( resTree* t, resTree_end end )
+{
+	t->end = end;
+}
+
+void resTree_insert( resTree* t, resNode* n )
+{
+	resNode* parent = NULL;
+	resNode* cur = t->root;
+	int goleft = 0;
+
+	n->left = NULL;
+	n->right = NULL;
+	n->height = 1;
+	if( t->end )
+		n->maxend = t->end( t->ctx, n->slot );
+
+	// Equal keys go right so insertion order is kept among ties
+	while( cur )
+	{
+		parent = cur;
+		goleft = t->cmp( t->ctx, n->slot, cur->slot ) < 0;
+		cur = goleft ? cur->left : cur->right;
+	}
+
+	n->parent = parent;
+	if( !parent )
+		t->root = n;
+	else if( goleft )
+		parent->left = n;
+	else
+		parent->right = n;
+
+	t->count++;
+	rebalance( t, parent );
+}
+
+void resTree_remove( resTree* t, resNode* n )
+{
+	resNode* from;
+
+	if( !n->left || !n->right )
+	{
+		from = n->parent;
+		replace_child( t, n->parent, n, n->left ? n->left : n->right );
+	} else {
+		// Splice the in-order successor into the place of n
+		resNode* s = n->right;
+		while( s->left )
+			s = s->left;
+
+		if( s->parent != n )
+		{
+			from = s->parent;
+			replace_child( t, s->parent, s, s->right );
+			s->right = n->right;
+			s->right->parent = s;
+		} else {
+			from = s;
+		}
+		replace_child( t, n->parent, n, s );
+		s->left = n->left;
+		s->left->parent = s;
+		s->height = n->height;
+	}
+
+	n->left = n->right = n->parent = NULL;
+	t->count--;
+	rebalance( t, from );
+}
+
+static void free_nodes( resNode* n )
+{
+	if( !n )
+		return;
+	free_nodes( n->left );
+	free_nodes( n->right );
+	free( n );
+}
+
+void resTree_free( resTree* t )
+{
+	free_nodes( t->root );
+	t->root = NULL;
+	t->count = 0;
+}
+
+resNode* resTree_first( resTree* t )
+{
+	resNode* n = t->root;
+	while( n && n->left )
+		n = n->left;
+	return n;
+}
+
+resNode* resTree_last( resTree* t )
+{
+	resNode* n = t->root;
+	while( n && n->right )
+		n = n->right;
+	return n;
+}
+
+resNode* resTree_next( resNode* n )
+{
+	if( n->right )
+	{
+		n = n->right;
+		while( n->left )
+			n = n->left;
+		return n;
+	}
+	while( n->parent && n->parent->right == n )
+		n = n->parent;
+	return n->parent;
+}
+
+resNode* resTree_prev( resNode* n )
+{
+	if( n->left )
+	{
+		n = n->left;
+		while( n->right )
+			n = n->right;
+		return n;
+	}
+	while( n->parent && n->parent->left == n )
+		n = n->parent;
+	return n->parent;
+}
+
+// Any node comparing equal to key
+resNode* resTree_find( resTree* t, const void* key, resTree_key_cmp keycmp )
+{
+	resNode* cur = t->root;
+	while( cur )
+	{
+		int cmp = keycmp( t->ctx, key, cur->slot );
+		if( cmp == 0 )
+			return cur;
+		cur = cmp < 0 ? cur->left : cur->right;
+	}
+	return NULL;
+}
+
+// First node whose slot is not ordered before key
+resNode* resTree_lower_bound( resTree* t, const void* key, resTree_key_cmp keycmp )
+{
+	resNode* found = NULL;
+	resNode* cur = t->root;
+	while( cur )
+	{
+		if( keycmp( t->ctx, key, cur->slot ) <= 0 )
+		{
+			found = cur;
+			cur = cur->left;
+		} else {
+			cur = cur->right;
+		}
+	}
+	return found;
+}
+
+// First node whose slot is ordered after key
+resNode* resTree_upper_bound( resTree* t, const void* key, resTree_key_cmp keycmp )
+{
+	resNode* found = NULL;
+	resNode* cur = t->root;
+	while( cur )
+	{
+		if( keycmp( t->ctx, key, cur->slot ) < 0 )
+		{
+			found = cur;
+			cur = cur->left;
+		} else {
+			cur = cur->right;
+		}
+	}
+	return found;
+}
+
+static void overlaps( resTree* t, resNode* n, time_t from, const void* key, resTree_key_cmp keycmp, resTree_visit visit, void* arg )
+{
+	// Nothing below n ends in time, and only right subtrees can start too late once n does
+	while( n && n->maxend >= from )
+	{
+		overlaps( t, n->left, from, key, keycmp, visit, arg );
+		if( keycmp( t->ctx, key, n->slot ) < 0 )
+			return;
+		if( t->end( t->ctx, n->slot ) >= from )
+			visit( arg, n->slot );
+		n = n->right;
+	}
+}
+
+/***
+ * Visits, in order, every slot ending at or after from and not ordered
+ * after key. For a tree ordered by start with key a time, that is every
+ * slot overlapping [from, key]. Subtrees ending before from and nodes
+ * starting after key are never entered, so with reservations of ordinary
+ * length a search costs O(log n) plus the slots it visits. The tree must
+ * have been given an end function with resTree_augment.
+ */
+void resTree_overlaps( resTree* t, time_t from, const void* key, resTree_key_cmp keycmp, resTree_visit visit, void* arg )
+{
+	overlaps( t, t->root, from, key, keycmp, visit, arg );
+}
+
+// Leftmost node under n ending at or after from; maxend shows which side holds it
+static resNode* first_ending( resTree* t, resNode* n, time_t from )
+{
+	while( n && n->maxend >= from )
+	{
+		if( n->left && n->left->maxend >= from )
+			n = n->left;
+		else if( t->end( t->ctx, n->slot ) >= from )
+			return n;
+		else
+			n = n->right;
+	}
+	return NULL;
+}
+
+/***
+ * The same walk as resTree_overlaps one node at a time, for callers that
+ * may stop early: resTree_first_ending gives the first node ending at or
+ * after from and resTree_next_ending the one after n. Subtrees ending too
+ * early are skipped the same way; stopping at the end of the range is left
+ * to the caller.
+ */
+resNode* resTree_first_ending( resTree* t, time_t from )
+{
+	return first_ending( t, t->root, from );
+}
+
+resNode* resTree_next_ending( resTree* t, resNode* n, time_t from )
+{
+	resNode* found = first_ending( t, n->right, from );
+	if( found )
+		return found;
+
+	// Every ancestor reached from its left comes next, then its right subtree
+	for( ; n->parent; n = n->parent )
+	{
+		resNode* p = n->parent;
+		if( p->left != n )
+			continue;
+		if( t->end( t->ctx, p->slot ) >= from )
+			return p;
+		found = first_ending( t, p->right, from );
+		if( found )
+			return found;
+	}
+	return NULL;
+}
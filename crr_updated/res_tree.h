@@ -0,0 +1,57 @@
+#ifndef RES_TREE_H
+#define RES_TREE_H
+
+#include <time.h>
+
+/***
+ * AVL tree over reservation slots.
+ *
+ * A node only remembers which slot of the reservation vector it stands for.
+ * Ordering is decided by the comparator given to resTree_init, which gets the
+ * tree context (the owning resVect) and two slot numbers.
+ *
+ * A tree ordered by start time (or start day) can also be given the end of
+ * each slot with resTree_augment. Every node then carries the latest end
+ * below it, which lets resTree_overlaps skip whole subtrees that finish too
+ * early.
+ */
+
+typedef int (*resTree_cmp)( const void* ctx, int leftslot, int rightslot );
+typedef int (*resTree_key_cmp)( const void* ctx, const void* key, int slot );
+typedef time_t (*resTree_end)( const void* ctx, int slot );
+typedef void (*resTree_visit)( void* arg, int slot );
+
+typedef struct ResNode {
+	struct ResNode* left;
+	struct ResNode* right;
+	struct ResNode* parent;
+	int height;
+	int slot;
+	time_t maxend;		// Latest end in this subtree, kept when the tree has an end function
+} resNode;
+
+typedef struct ResTree {
+	resNode* root;
+	int count;
+	resTree_cmp cmp;
+	resTree_end end;	// NULL unless resTree_augment was called
+	const void* ctx;
+} resTree;
+
+void resTree_init( resTree* t, resTree_cmp cmp, const void* ctx );
+void resTree_augment( resTree* t, resTree_end end );
+void resTree_insert( resTree* t, resNode* n );
+void resTree_remove( resTree* t, resNode* n );
+void resTree_free( resTree* t );
+resNode* resTree_first( resTree* t );
+resNode* resTree_last( resTree* t );
+resNode* resTree_next( resNode* n );
+resNode* resTree_prev( resNode* n );
+resNode* resTree_find( resTree* t, const void* key, resTree_key_cmp keycmp );
+resNode* resTree_lower_bound( resTree* t, const void* key, resTree_key_cmp keycmp );
+resNode* resTree_upper_bound( resTree* t, const void* key, resTree_key_cmp keycmp );
+void resTree_overlaps( resTree* t, time_t from, const void* key, resTree_key_cmp keycmp, resTree_visit visit, void* arg );
+resNode* resTree_first_ending( resTree* t, time_t from );
+resNode* resTree_next_ending( resTree* t, resNode* n, time_t from );
+
+#endif
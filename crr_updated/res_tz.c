@@ -0,0 +1,182 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "res_tz.h"
+
+typedef struct Tz_Table {
+	time_t lo;				// Offsets are known for lo..hi
+	time_t hi;
+	int count;
+	time_t* at;				// Offset off[i] holds from at[i]; at[0] is lo
+	long* off;
+	struct Tz_Table* retired;	// Older tables, kept until exit since readers may still hold them
+} tzTable;
+
+static tzTable* current = NULL;
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long zone_offset( time_t t )
+{
+	struct tm local;
+	localtime_r( &t, &local );
+	return local.tm_gmtoff;
+}
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for the time zone offset table.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error converting times. Quitting the program." );
+	exit(1);
+}
+
+static void append( tzTable* tz, int* size, time_t at, long off )
+{
+	if( tz->count == *size )
+	{
+		*size *= 2;
+		tz->at = realloc( tz->at, sizeof(time_t) * *size );	// REQ4
+		tz->off = realloc( tz->off, sizeof(long) * *size );	// REQ4
+		if( !tz->at || !tz->off )
+			alloc_error();
+	}
+	tz->at[tz->count] = at;
+	tz->off[tz->count] = off;
+	tz->count++;
+}
+
+// Samples lo..hi a day apart and pins every change of offset down to the second
+static tzTable* build( time_t lo, time_t hi )
+{
+	tzTable* tz = malloc( sizeof(tzTable) );	// REQ4
+	int size = 16;
+	if( !tz )
+		alloc_error();
+	tz->lo = lo;
+	tz->hi = hi;
+	tz->count = 0;
+	tz->at = malloc( sizeof(time_t) * size );	// REQ4
+	tz->off = malloc( sizeof(long) * size );	// REQ4
+	if( !tz->at || !tz->off )
+		alloc_error();
+
+	long off = zone_offset( lo );
+	append( tz, &size, lo, off );
+	for( time_t t = lo; t < hi; )
+	{
+		time_t next = hi - t > TZ_SAMPLE_SECONDS ? t + TZ_SAMPLE_SECONDS : hi;
+		long nextoff = zone_offset( next );
+		if( nextoff != off )
+		{
+			// The change happens somewhere in (t, next]
+			time_t before = t;
+			time_t after = next;
+			while( after - before > 1 )
+			{
+				time_t mid = before + (after - before) / 2;
+				if( zone_offset( mid ) == off )
+					before = mid;
+				else
+					after = mid;
+			}
+			append( tz, &size, after, nextoff );
+			off = nextoff;
+		}
+		t = next;
+	}
+	tz->retired = NULL;
+	return tz;
+}
+
+// Makes sure the published table covers lo..hi; returns 0 if that would be too wide
+static int extend( time_t lo, time_t hi )
+{
+	pthread_mutex_lock( &grow_lock );
+	tzTable* tz = current;
+	if( tz && tz->lo <= lo && hi <= tz->hi )
+	{
+		pthread_mutex_unlock( &grow_lock );
+		return 1;
+	}
+
+	if( tz )
+	{
+		if( tz->lo < lo )
+			lo = tz->lo;
+		if( tz->hi > hi )
+			hi = tz->hi;
+	}
+	if( (long long)hi - lo > TZ_MAX_SPAN_SECONDS )
+	{
+		pthread_mutex_unlock( &grow_lock );
+		return 0;
+	}
+
+	tzTable* grown = build( lo, hi );
+	grown->retired = tz;
+	__atomic_store_n( &current, grown, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &grow_lock );
+	return 1;
+}
+
+// Seconds east of UTC in the local zone at t, as localtime_r gives in tm_gmtoff
+long resTz_offset( time_t t )
+{
+	// Far enough out that widening the table could overflow
+	if( t < -((time_t)1 << 40) || t > ((time_t)1 << 40) )
+		return zone_offset( t );
+
+	tzTable* tz = __atomic_load_n( &current, __ATOMIC_ACQUIRE );
+	if( !tz || t < tz->lo || t > tz->hi )
+	{
+		time_t lo = t - TZ_EXTEND_SECONDS;
+		time_t hi = t + TZ_EXTEND_SECONDS;
+		if( tz && t < tz->lo )
+			lo = t - (tz->hi - tz->lo > TZ_EXTEND_SECONDS ? tz->hi - tz->lo : TZ_EXTEND_SECONDS);
+		if( tz && t > tz->hi )
+			hi = t + (tz->hi - tz->lo > TZ_EXTEND_SECONDS ? tz->hi - tz->lo : TZ_EXTEND_SECONDS);
+		if( !extend( lo, hi ) && !extend( t, t ) )
+			return zone_offset( t );
+		tz = __atomic_load_n( &current, __ATOMIC_ACQUIRE );
+		if( t < tz->lo || t > tz->hi )
+			return zone_offset( t );
+	}
+
+	// Last transition at or before t
+	int low = 0;
+	int high = tz->count - 1;
+	while( low < high )
+	{
+		int mid = low + (high - low + 1) / 2;
+		if( tz->at[mid] <= t )
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return tz->off[low];
+}
+
+// Builds the table for a known span up front, such as that of a loaded schedule
+void resTz_cover( time_t lo, time_t hi )
+{
+	if( lo <= hi )
+		extend( lo - TZ_SAMPLE_SECONDS, hi + TZ_SAMPLE_SECONDS );
+}
+
+void resTz_free( void )	// REQ4
+{
+	pthread_mutex_lock( &grow_lock );
+	tzTable* tz = current;
+	current = NULL;
+	while( tz )
+	{
+		tzTable* retired = tz->retired;
+		free( tz->at );
+		free( tz->off );
+		free( tz );
+		tz = retired;
+	}
+	pthread_mutex_unlock( &grow_lock );
+}
@@ -0,0 +1,22 @@
+#ifndef RES_TZ_H
+#define RES_TZ_H
+
+/***
+ * UTC offset cache for the local time zone.
+ *
+ * The offsets in force over a span of time are worked out once with
+ * localtime_r and kept as a sorted table of transitions, so an offset lookup
+ * is a binary search. The table grows when a time outside it is asked for.
+ * Readers take the current table with an atomic load and never lock;
+ * growing builds a new table under a mutex and publishes it whole.
+ */
+
+#define TZ_SAMPLE_SECONDS (24 * 60 * 60)			// Offsets are assumed to change at most once a day
+#define TZ_EXTEND_SECONDS (366 * 24 * 60 * 60)		// Least the table grows by
+#define TZ_MAX_SPAN_SECONDS (200LL * 366 * 24 * 60 * 60)	// Times further out go straight to localtime_r
+
+long resTz_offset( time_t t );
+void resTz_cover( time_t lo, time_t hi );
+void resTz_free( void );
+
+#endif
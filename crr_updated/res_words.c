@@ -0,0 +1,244 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "reservation.h"
+#include "res_words.h"
+
+// Copies the next word of text into word (folded to lower case) and returns where scanning stopped
+static const char* next_word( const char* text, char* word )
+{
+	while( *text && !isalnum( (unsigned char)*text ) )
+		text++;
+
+	int len = 0;
+	while( *text && isalnum( (unsigned char)*text ) )
+	{
+		if( len < DESC_SIZE - 1 )
+			word[len++] = tolower( (unsigned char)*text );
+		text++;
+	}
+	word[len] = '\0';
+	return text;
+}
+
+static unsigned int hash_word( const char* word )	// FNV-1a
+{
+	unsigned int h = 2166136261u;
+	while( *word )
+	{
+		h ^= (unsigned char)*word++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// The table cell holding word, or the free cell where it belongs
+static int* find_cell( resWords* w, int* table, int capacity, const char* word )
+{
+	unsigned int i = hash_word( word ) & (capacity - 1);
+	while( table[i] && strcmp( w->entries[table[i] - 1].word, word ) != 0 )
+		i = (i + 1) & (capacity - 1);
+	return &table[i];
+}
+
+static void alloc_error( void )	// REQ6
+{
+	fputs( "Error allocating memory for the description word index.", stderr );
+	snprintf( RES_ERROR_STR, BUFF, "Error indexing reservation descriptions. Quitting the program." );
+	exit(1);
+}
+
+static void grow_table( resWords* w )
+{
+	int capacity = w->capacity ? w->capacity * 2 : 256;
+	int* table = calloc( capacity, sizeof(int) );	// REQ4
+	if( !table )
+		alloc_error();
+
+	for( int i = 0; i < w->used; i++ )
+		*find_cell( w, table, capacity, w->entries[i].word ) = i + 1;
+	if( w->table )
+		free( w->table );
+	w->table = table;
+	w->capacity = capacity;
+}
+
+// The entry of word, made empty if the word is new
+static int word_entry( resWords* w, const char* word )
+{
+	// Keep the table at most 3/4 full
+	if( (w->used + 1) * 4 > w->capacity * 3 )
+		grow_table( w );
+
+	int* cell = find_cell( w, w->table, w->capacity, word );
+	if( *cell )
+		return *cell - 1;
+
+	if( w->used == w->entrysize )
+	{
+		w->entrysize = w->entrysize ? w->entrysize * 2 : 256;
+		if( !(w->entries = realloc( w->entries, sizeof(wordEntry) * w->entrysize )) )	// REQ4
+			alloc_error();
+	}
+	wordEntry* e = &w->entries[w->used];
+	if( !(e->word = strdup( word )) )	// REQ4
+		alloc_error();
+	e->slots = NULL;
+	e->refs = NULL;
+	e->count = 0;
+	e->size = 0;
+	*cell = ++w->used;
+	return w->used - 1;
+}
+
+void resWords_init( resWords* w )
+{
+	w->table = NULL;
+	w->capacity = 0;
+	w->entries = NULL;
+	w->used = 0;
+	w->entrysize = 0;
+	w->slotwords = NULL;
+	w->slotsize = 0;
+}
+
+void resWords_free( resWords* w )	// REQ4
+{
+	for( int i = 0; i < w->used; i++ )
+	{
+		free( w->entries[i].word );
+		if( w->entries[i].slots )
+			free( w->entries[i].slots );
+		if( w->entries[i].refs )
+			free( w->entries[i].refs );
+	}
+	for( int i = 0; i < w->slotsize; i++ )
+	{
+		if( w->slotwords[i].postings )
+			free( w->slotwords[i].postings );
+	}
+	if( w->table )
+		free( w->table );
+	if( w->entries )
+		free( w->entries );
+	if( w->slotwords )
+		free( w->slotwords );
+	resWords_init( w );
+}
+
+void resWords_add( resWords* w, const char* desc, int slot )
+{
+	char word[DESC_SIZE];
+
+	if( slot >= w->slotsize )
+	{
+		int size = w->slotsize ? w->slotsize : 256;
+		while( size <= slot )
+			size *= 2;
+		if( !(w->slotwords = realloc( w->slotwords, sizeof(slotWords) * size )) )	// REQ4
+			alloc_error();
+		memset( w->slotwords + w->slotsize, 0, sizeof(slotWords) * (size - w->slotsize) );
+		w->slotsize = size;
+	}
+	slotWords* sw = &w->slotwords[slot];
+
+	// next_word skips separators first, so an empty word means the text is used up
+	for( desc = next_word( desc, word ); word[0]; desc = next_word( desc, word ) )
+	{
+		int entry = word_entry( w, word );
+		wordEntry* e = &w->entries[entry];
+
+		// A word repeated within one description is only posted once
+		if( e->count && e->slots[e->count - 1] == slot )
+			continue;
+
+		if( e->count == e->size )
+		{
+			e->size = e->size ? e->size * 2 : 4;
+			if( !(e->slots = realloc( e->slots, sizeof(int) * e->size )) )	// REQ4
+				alloc_error();
+			if( !(e->refs = realloc( e->refs, sizeof(int) * e->size )) )	// REQ4
+				alloc_error();
+		}
+		if( sw->count == sw->size )
+		{
+			sw->size = sw->size ? sw->size * 2 : 4;
+			if( !(sw->postings = realloc( sw->postings, sizeof(wordPosting) * sw->size )) )	// REQ4
+				alloc_error();
+		}
+		e->slots[e->count] = slot;
+		e->refs[e->count] = sw->count;
+		sw->postings[sw->count].entry = entry;
+		sw->postings[sw->count].pos = e->count;
+		sw->count++;
+		e->count++;
+	}
+}
+
+void resWords_remove( resWords* w, int slot )
+{
+	if( slot >= w->slotsize )
+		return;
+
+	slotWords* sw = &w->slotwords[slot];
+	for( int i = 0; i < sw->count; i++ )
+	{
+		// Fill the hole with the last posting of the word and tell its slot where it went
+		wordEntry* e = &w->entries[sw->postings[i].entry];
+		int pos = sw->postings[i].pos;
+		int last = --e->count;
+		if( pos == last )
+			continue;
+		e->slots[pos] = e->slots[last];
+		e->refs[pos] = e->refs[last];
+		w->slotwords[e->slots[pos]].postings[e->refs[pos]].pos = pos;
+	}
+	sw->count = 0;
+}
+
+// Moves the postings of from over to to, which must have none of its own
+void resWords_move( resWords* w, int from, int to )
+{
+	if( from >= w->slotsize )
+		return;
+
+	slotWords* sw = &w->slotwords[from];
+	for( int i = 0; i < sw->count; i++ )
+		w->entries[sw->postings[i].entry].slots[sw->postings[i].pos] = to;
+
+	slotWords spare = w->slotwords[to];
+	w->slotwords[to] = *sw;
+	*sw = spare;
+}
+
+const int* resWords_lookup( resWords* w, const char* word, int* count )
+{
+	char folded[DESC_SIZE];
+	next_word( word, folded );
+
+	*count = 0;
+	if( !w->capacity || !folded[0] )
+		return NULL;
+
+	int cell = *find_cell( w, w->table, w->capacity, folded );
+	if( !cell )
+		return NULL;
+	*count = w->entries[cell - 1].count;
+	return w->entries[cell - 1].slots;
+}
+
+// Non-zero if key is exactly one word, which the index can answer on its own
+int resWords_is_word( const char* key )
+{
+	if( !*key )
+		return 0;
+	for( ; *key; key++ )
+	{
+		if( !isalnum( (unsigned char)*key ) )
+			return 0;
+	}
+	return 1;
+}
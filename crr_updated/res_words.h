@@ -0,0 +1,53 @@
+#ifndef RES_WORDS_H
+#define RES_WORDS_H
+
+/***
+ * Inverted index from description words to reservation slots.
+ *
+ * A word is a run of letters and digits, folded to lower case. Each word
+ * keeps the slots whose description contains it, so a lookup costs one hash
+ * probe plus the number of hits no matter how big the schedule is.
+ */
+
+typedef struct Word_Entry {
+	char* word;
+	int* slots;				// Slots whose description contains the word
+	int* refs;				// refs[i] is where this posting sits in the postings of slots[i]
+	int count;
+	int size;
+} wordEntry;
+
+typedef struct Word_Posting {
+	int entry;				// Index into entries
+	int pos;				// Position in the slots of that entry
+} wordPosting;
+
+typedef struct Slot_Words {
+	wordPosting* postings;	// One per distinct word of the slot's description
+	int count;
+	int size;
+} slotWords;
+
+/***
+ * Every slot keeps where each of its postings sits, so removing or moving a
+ * slot touches only its own words instead of searching the posting lists.
+ */
+typedef struct Word_Index {
+	int* table;				// Open addressing, linear probing; entry index + 1, 0 marks a free hash slot
+	int capacity;
+	wordEntry* entries;		// Never shrinks, so entry indices stay valid
+	int used;
+	int entrysize;
+	slotWords* slotwords;	// Indexed by slot
+	int slotsize;
+} resWords;
+
+void resWords_init( resWords* w );
+void resWords_free( resWords* w );
+void resWords_add( resWords* w, const char* desc, int slot );
+void resWords_remove( resWords* w, int slot );
+void resWords_move( resWords* w, int from, int to );
+const int* resWords_lookup( resWords* w, const char* word, int* count );
+int resWords_is_word( const char* key );
+
+#endif
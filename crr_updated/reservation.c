@@ -1,14 +1,23 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "search_sort_utils.h"
 #include "reservation.h"
+#include "desc_match.h"
+#include "res_journal.h"
+#include "res_recur.h"
+#include "res_stats.h"
+#include "res_tz.h"
 
 char RES_ERROR_STR[BUFF] = "";	// REQ6
-int res_lookup_size = 0;
+__thread int res_lookup_size = 0;	// Per thread, so snapshot readers don't race the writer
 
 #define ERROR_RES( fp, ...) res_error( fp, __FUNCTION__, __LINE__, __VA_ARGS__ "" )		// REQ6
 
@@ -26,18 +35,29 @@ void res_error( FILE* fp, const char* functionname, int lineno, const char* op )
 
 time_t to_local( time_t t )		// REQ11
 {
-	struct tm utc;
-	localtime_r( &t, &utc );
-	t += utc.tm_gmtoff;
-	return t;
+	return t + resTz_offset( t );
 }
 
 time_t to_utc( time_t t )		// REQ11
 {
-	struct tm localzone;
-	localtime_r( &t, &localzone );
-	t -= localzone.tm_gmtoff;
-	return t;
+	return t - resTz_offset( t );
+}
+
+// Local calendar day of an epoch time, counted in days from 1970-01-01
+int res_local_day( time_t t )
+{
+	time_t local = t + resTz_offset( t );
+	time_t day = local / (24 * 60 * 60);
+	if( local % (24 * 60 * 60) < 0 )
+		day--;
+	return (int)day;
+}
+
+// 0 for Sunday like tm_wday; 1970-01-01 was a Thursday
+int res_day_weekday( int day )
+{
+	int wday = (day + 4) % 7;
+	return wday < 0 ? wday + 7 : wday;
 }
 
 reservation create_reservation( const char* roomname, const time_t start, const time_t end, const char* desc )
@@ -88,6 +108,34 @@ void resVect_init( resVect* v )
 	v->data = NULL;
 	v->size = 0;
 	v->count = 0;
+	v->roomids = NULL;
+	v->starts = NULL;
+	v->ends = NULL;
+	v->nodes = NULL;
+	v->timenodes = NULL;
+	v->startdays = NULL;
+	v->enddays = NULL;
+	v->daynodes = NULL;
+	resTree_init( &v->timeline, tree_time_room_cmp, v );
+	resTree_augment( &v->timeline, tree_slot_end );
+	resTree_init( &v->days, tree_day_cmp, v );
+	resTree_augment( &v->days, tree_slot_endday );
+	resWords_init( &v->words );
+	resAvail_init( &v->avail, RES_AVAIL_GRANULARITY );
+	v->rooms = NULL;
+	v->roomorder = NULL;
+	v->roomcount = 0;
+	v->roomsize = 0;
+	v->roomnames = NULL;
+	v->internedrooms = 0;
+	v->indexed = 1;
+	v->mapped = 0;
+	v->checkrooms = 0;
+	v->journal = NULL;
+	v->series = NULL;
+	v->seriesrooms = NULL;
+	v->seriescount = 0;
+	v->seriessize = 0;
 }
 
 int resVect_count( resVect* v )
@@ -95,46 +143,399 @@ int resVect_count( resVect* v )
 	return v->count;
 }
 
-reservation* resVect_add( resVect* v, reservation res )
+// Finds the id of a room's schedule, optionally creating an empty one. Returns -1 if there is none.
+static int resVect_room( resVect* v, const char* roomname, int create )
 {
+	int lo = 0;
+	int hi = v->roomcount - 1;
+	while( lo <= hi )
+	{
+		int mid = lo + (hi - lo) / 2;
+		int cmp = strcasecmp( roomname, v->rooms[v->roomorder[mid]].roomname );
+		if( cmp == 0 )
+			return v->roomorder[mid];
+		if( cmp < 0 )
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
 
-	reservation* check = bsearch( &res, v->data, v->count, sizeof(reservation), bsearch_conflict );	// REQ5, REQ7
-
-	if( check )
-		return check;
+	if( !create )
+		return -1;
 
-	// Add non-conflict reservation
-	if( v->size == 0 )
+	if( v->roomsize == v->roomcount )
 	{
-		v->size = 5;
-		v->data = calloc( v->size, sizeof(reservation) );	// REQ4
-		if( !(v->data) )	// REQ6
+		v->roomsize = v->roomsize ? v->roomsize * 2 : 5;
+		v->rooms = realloc( v->rooms, sizeof(resRoom) * v->roomsize );	// REQ4
+		v->roomorder = realloc( v->roomorder, sizeof(int) * v->roomsize );	// REQ4
+		if( !(v->rooms) || !(v->roomorder) )	// REQ6
 		{
-			ERROR_RES( stderr, "Error allocating memory adding a reservation" );
+			ERROR_RES( stderr, "Error allocating memory for a room schedule" );
 			snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
 			exit(1);
 		}
 	}
 
-	if( v->size == v->count )
+	// Room ids never change once handed out; only the name order shifts
+	int id = v->roomcount++;
+	memmove( &v->roomorder[lo + 1], &v->roomorder[lo], sizeof(int) * (id - lo) );
+	v->roomorder[lo] = id;
+
+	strncpy( v->rooms[id].roomname, roomname, sizeof( v->rooms[id].roomname ) );
+	resTree_init( &v->rooms[id].schedule, tree_start_cmp, v );
+	v->rooms[id].series = NULL;
+	v->rooms[id].seriescount = 0;
+	v->rooms[id].seriessize = 0;
+	return id;
+}
+
+/***
+ * Interns the sorted rooms.dat table so that rooms[i] gets room id i. Must be
+ * called before any reservation is added or loaded. Reservations then carry
+ * the id and room names are only resolved to show them.
+ */
+void resVect_set_rooms( resVect* v, char** rooms, int numrooms )
+{
+	for( int i = 0; i < numrooms; i++ )
+		resVect_room( v, rooms[i], 1 );
+
+	// Names repeated in rooms.dat collapse into one id, so then ids can't stand for positions
+	if( v->roomcount == numrooms )
 	{
-		v->size *= 2;
-		v->data = realloc( v->data, sizeof(reservation) * v->size );	// REQ4
-		if( !(v->data) )	// REQ6
+		v->roomnames = rooms;
+		v->internedrooms = numrooms;
+	}
+}
+
+/***
+ * First occurrence of a room's recurring series overlapping [start, end),
+ * found from the rules without expanding them. Returns the series and sets
+ * *k, or returns -1. Series number except is passed over.
+ */
+static int series_conflict( resVect* v, int roomid, time_t start, time_t end, int except, int* k )
+{
+	resRoom* room = &v->rooms[roomid];
+	for( int j = 0; j < room->seriescount; j++ )
+	{
+		int i = room->series[j];
+		if( i != except && (*k = resRecur_overlap( &v->series[i], start, end )) >= 0 )
+			return i;
+	}
+	return -1;
+}
+
+// Returns the reservation in a room overlapping res, if there is one
+static reservation* room_conflict( resVect* v, int roomid, reservation* res )	// REQ7
+{
+	resTree* schedule = &v->rooms[roomid].schedule;
+
+	// Reservations in a room never overlap, so only the last one starting before res ends can collide
+	resNode* n = resTree_lower_bound( schedule, &res->endtime, tree_start_key_cmp );
+	n = n ? resTree_prev( n ) : resTree_last( schedule );
+
+	if( n && v->ends[n->slot] > res->starttime )
+		return &v->data[n->slot];
+
+	// A recurring series in the way is reported through the occurrence it collides with
+	int k;
+	int series = series_conflict( v, roomid, res->starttime, res->endtime, -1, &k );
+	if( series >= 0 )
+	{
+		v->occurrence = resRecur_occurrence( &v->series[series], k );
+		return &v->occurrence;
+	}
+	return NULL;
+}
+
+// Whether a room has a reservation meeting any part of [start, end]
+static int room_reserved_between( resVect* v, int roomid, time_t start, time_t end )
+{
+	resTree* schedule = &v->rooms[roomid].schedule;
+	resNode* n = resTree_upper_bound( schedule, &end, tree_start_key_cmp );
+	n = n ? resTree_prev( n ) : resTree_last( schedule );
+
+	return n && start <= v->ends[n->slot];
+}
+
+static resNode* resVect_slot_node( resNode** nodes, int slot )
+{
+	if( !nodes[slot] )
+	{
+		nodes[slot] = malloc( sizeof(resNode) );	// REQ4
+		if( !nodes[slot] )	// REQ6
 		{
-			ERROR_RES( stderr, "Error allocating memory adding a reservation" );
+			ERROR_RES( stderr, "Error allocating memory indexing a reservation" );
 			snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
 			exit(1);
 		}
 	}
+	nodes[slot]->slot = slot;
+	return nodes[slot];
+}
+
+// Fills the hot columns of a slot from its record
+static void resVect_columns( resVect* v, int slot )
+{
+	v->roomids[slot] = resVect_room( v, v->data[slot].roomname, 1 );
+	v->starts[slot] = v->data[slot].starttime;
+	v->ends[slot] = v->data[slot].endtime;
+
+	// Day keys are worked out once here so day searches do no time zone work
+	v->startdays[slot] = res_local_day( to_local( v->starts[slot] ) );
+	v->enddays[slot] = res_local_day( to_local( v->ends[slot] ) );
+}
+
+// Links a slot into its room schedule, the timeline, the word index and the availability bitmaps
+static void resVect_index_slot( resVect* v, int slot )
+{
+	resTree_insert( &v->rooms[v->roomids[slot]].schedule, resVect_slot_node( v->nodes, slot ) );
+	resTree_insert( &v->timeline, resVect_slot_node( v->timenodes, slot ) );
+	resTree_insert( &v->days, resVect_slot_node( v->daynodes, slot ) );
+	resWords_add( &v->words, v->data[slot].description, slot );
+	resAvail_mark( &v->avail, v->roomids[slot], v->starts[slot], v->ends[slot] );
+}
+
+static void resVect_unindex_slot( resVect* v, int slot )
+{
+	int roomid = v->roomids[slot];
+	resTree* schedule = &v->rooms[roomid].schedule;
+
+	resTree_remove( schedule, v->nodes[slot] );
+	resTree_remove( &v->timeline, v->timenodes[slot] );
+	resTree_remove( &v->days, v->daynodes[slot] );
+	resWords_remove( &v->words, slot );
+	resAvail_clear( &v->avail, roomid, v->starts[slot], v->ends[slot] );
+
+	// Put back the bits of other reservations of the room sharing its first or last time slot
+	time_t edges[2] = { v->starts[slot], v->ends[slot] };
+	for( int e = 0; e < 2; e++ )
+	{
+		time_t slotstart, slotend;
+		resAvail_slot_bounds( &v->avail, edges[e], &slotstart, &slotend );
+
+		resNode* n = resTree_upper_bound( schedule, &slotend, tree_start_key_cmp );
+		n = n ? resTree_prev( n ) : resTree_last( schedule );
+		for( ; n && (v->ends[n->slot] >= slotstart || v->starts[n->slot] >= slotstart); n = resTree_prev( n ) )
+		{
+			time_t start = v->starts[n->slot] > slotstart ? v->starts[n->slot] : slotstart;
+			time_t end = v->ends[n->slot] < slotend ? v->ends[n->slot] : slotend;
+			resAvail_mark( &v->avail, roomid, start, end );
+		}
+	}
+}
+
+static void resVect_store( resVect* v, int slot, reservation* res )
+{
+	v->data[slot] = *res;
+	resVect_columns( v, slot );
+	resVect_index_slot( v, slot );
+}
+
+static void resVect_alloc_columns( resVect* v )
+{
+	v->roomids = realloc( v->roomids, sizeof(int) * v->size );		// REQ4
+	v->starts = realloc( v->starts, sizeof(time_t) * v->size );		// REQ4
+	v->ends = realloc( v->ends, sizeof(time_t) * v->size );			// REQ4
+	v->nodes = realloc( v->nodes, sizeof(resNode*) * v->size );		// REQ4
+	v->timenodes = realloc( v->timenodes, sizeof(resNode*) * v->size );	// REQ4
+	v->startdays = realloc( v->startdays, sizeof(int) * v->size );		// REQ4
+	v->enddays = realloc( v->enddays, sizeof(int) * v->size );			// REQ4
+	v->daynodes = realloc( v->daynodes, sizeof(resNode*) * v->size );	// REQ4
+	if( !(v->roomids) || !(v->starts) || !(v->ends) || !(v->nodes) || !(v->timenodes)
+		|| !(v->startdays) || !(v->enddays) || !(v->daynodes) )	// REQ6
+	{
+		ERROR_RES( stderr, "Error allocating memory for reservation columns" );
+		snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
+		exit(1);
+	}
+}
 
-	v->data[v->count] = res;
+static void resVect_grow( resVect* v, int needed )
+{
+	if( v->size >= needed )
+		return;
+
+	if( v->size == 0 )
+		v->size = 5;
+	while( v->size < needed )
+		v->size *= 2;
+
+	if( v->mapped )
+	{
+		// Out of reserved address space; move the records onto the heap
+		reservation* heap = malloc( sizeof(reservation) * v->size );	// REQ4
+		if( heap )
+			memcpy( heap, v->data, sizeof(reservation) * v->count );
+		munmap( v->data, v->mapped );
+		v->data = heap;
+		v->mapped = 0;
+	} else {
+		v->data = realloc( v->data, sizeof(reservation) * v->size );	// REQ4
+	}
+	if( !(v->data) )	// REQ6
+	{
+		ERROR_RES( stderr, "Error allocating memory adding a reservation" );
+		snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
+		exit(1);
+	}
+	resVect_alloc_columns( v );
+}
+
+static void resVect_check_rooms( resVect* v );
+
+/***
+ * Builds the hot columns, room schedules and timeline for records loaded
+ * without them. The index is all or nothing: the first operation that
+ * needs any of it indexes every record, touching every page of a mapped
+ * schedule, so mapping defers the load rather than avoiding it.
+ */
+void resVect_need_index( resVect* v )
+{
+	if( v->indexed )
+		return;
+	v->indexed = 1;
+
+	resVect_alloc_columns( v );
+
+	// One pass for the span lets the offset table be built once rather than grown piecemeal
+	time_t lo = 0;
+	time_t hi = 0;
+	for( int i = 0; i < v->count; i++ )
+	{
+		if( i == 0 || v->data[i].starttime < lo )
+			lo = v->data[i].starttime;
+		if( i == 0 || v->data[i].endtime > hi )
+			hi = v->data[i].endtime;
+	}
+	if( v->count )
+		resTz_cover( lo, hi );
+
+	for( int i = 0; i < v->count; i++ )
+	{
+		v->nodes[i] = NULL;
+		v->timenodes[i] = NULL;
+		v->daynodes[i] = NULL;
+		resVect_columns( v, i );
+		resVect_index_slot( v, i );
+	}
+	resVect_check_rooms( v );	// REQ8
+}
+
+// Stores a reservation known not to conflict in a slot already grown for it
+static void resVect_append( resVect* v, reservation* res )
+{
+	v->nodes[v->count] = NULL;
+	v->timenodes[v->count] = NULL;
+	v->daynodes[v->count] = NULL;
+	resVect_store( v, v->count, res );
 	v->count++;
 
-	qsort( v->data, v->count, sizeof(reservation), sort_name_time );	// REQ5
+	if( v->journal )
+		resJournal_log( v->journal, JOURNAL_ADD, NULL, res );
+}
+
+reservation* resVect_add( resVect* v, reservation res )
+{
+	RES_STAT_TIMER( STAT_ADD );
+	resVect_need_index( v );
+	reservation* check = room_conflict( v, resVect_room( v, res.roomname, 1 ), &res );	// REQ7
+
+	if( check )
+	{
+		RES_STAT_FAILED();
+		return check;
+	}
+
+	// Add non-conflict reservation
+	resVect_grow( v, v->count + 1 );
+	resVect_append( v, &res );
 	return NULL;
 }
 
+/***
+ * Adds n reservations at once. The incoming set is sorted by room and start
+ * a single time, then each room is swept once alongside its schedule: a
+ * reservation is taken unless it overlaps one already in the schedule or
+ * one taken before it in the sweep. Of two overlapping incoming
+ * reservations the earlier start wins, and on equal starts the earlier
+ * position in incoming.
+ *
+ * conflicts[i] says what kept incoming[i] out. Its existing field is the
+ * index of a reservation already in the schedule, and its incoming field
+ * is the position of an incoming one; both are -1 when incoming[i] was
+ * added. Returns how many were added.
+ */
+int resVect_import( resVect* v, reservation* incoming, int n, resImportConflict* conflicts )
+{
+	RES_STAT_TIMER( STAT_IMPORT );
+	resVect_need_index( v );
+
+	importKey* keys = malloc( sizeof(importKey) * (n ? n : 1) );	// REQ4
+	char* accepted = calloc( n ? n : 1, sizeof(char) );			// REQ4
+	if( !keys || !accepted )	// REQ6
+	{
+		ERROR_RES( stderr, "Error allocating memory importing reservations" );
+		snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
+		exit(1);
+	}
+	for( int i = 0; i < n; i++ )
+	{
+		keys[i].roomid = resVect_room( v, incoming[i].roomname, 1 );
+		keys[i].start = incoming[i].starttime;
+		keys[i].pos = i;
+		conflicts[i].existing = -1;
+		conflicts[i].incoming = -1;
+		conflicts[i].series = -1;
+	}
+	qsort( keys, n, sizeof(importKey), sort_import_key );	// REQ5
+
+	int added = 0;
+	int k;
+	for( int i = 0; i < n; )
+	{
+		int roomid = keys[i].roomid;
+		resTree* schedule = &v->rooms[roomid].schedule;
+
+		// Nothing before the last reservation starting at or before the first key can reach it
+		resNode* e = resTree_upper_bound( schedule, &keys[i].start, tree_start_key_cmp );
+		e = e ? resTree_prev( e ) : resTree_last( schedule );
+		if( !e )
+			e = resTree_first( schedule );
+
+		int last = -1;		// Latest incoming taken for this room
+		for( ; i < n && keys[i].roomid == roomid; i++ )
+		{
+			reservation* res = &incoming[keys[i].pos];
+			resImportConflict* c = &conflicts[keys[i].pos];
+
+			while( e && v->ends[e->slot] <= res->starttime )
+				e = resTree_next( e );
+
+			if( e && v->starts[e->slot] < res->endtime )
+				c->existing = e->slot;
+			else if( last >= 0 && incoming[last].endtime > res->starttime )
+				c->incoming = last;
+			else if( (c->series = series_conflict( v, roomid, res->starttime, res->endtime, -1, &k )) < 0 ) {
+				accepted[keys[i].pos] = 1;
+				last = keys[i].pos;
+				added++;
+			}
+		}
+	}
+
+	// Taken reservations go in after the sweep so it only ever compares against the old schedule
+	resVect_grow( v, v->count + added );
+	for( int i = 0; i < n; i++ )
+	{
+		if( accepted[i] )
+			resVect_append( v, &incoming[i] );
+	}
+
+	free( keys );		// REQ4
+	free( accepted );	// REQ4
+	return added;
+}
+
 void resVect_set( resVect* v, int index, reservation res )
 {
 	if( index >= v->count || index < 0 )	// REQ6
@@ -143,7 +544,38 @@ void resVect_set( resVect* v, int index, reservation res )
 		snprintf( RES_ERROR_STR, BUFF, "Error inserting a reservation. Quitting the program." );
 		exit(1);
 	}
-	v->data[index] = res;
+	resVect_need_index( v );
+	if( v->journal )
+		resJournal_log( v->journal, JOURNAL_UPDATE, &v->data[index], &res );
+	resVect_unindex_slot( v, index );
+	resVect_store( v, index, &res );
+}
+
+reservation* resVect_update( resVect* v, int index, reservation res )
+{
+	RES_STAT_TIMER( STAT_UPDATE );
+	if( index >= v->count || index < 0 )	// REQ6
+	{
+		fprintf( stderr, "%s:%d: index out of bounds with index %i.\n", __FUNCTION__, __LINE__, index );
+		snprintf( RES_ERROR_STR, BUFF, "Error updating a reservation. Quitting the program." );
+		exit(1);
+	}
+	resVect_need_index( v );
+
+	// Take the old reservation out first so it can't conflict with its own new times
+	resVect_unindex_slot( v, index );
+	reservation* check = room_conflict( v, resVect_room( v, res.roomname, 1 ), &res );	// REQ7
+	if( check )
+	{
+		RES_STAT_FAILED();
+		resVect_index_slot( v, index );
+		return check;
+	}
+
+	if( v->journal )
+		resJournal_log( v->journal, JOURNAL_UPDATE, &v->data[index], &res );
+	resVect_store( v, index, &res );
+	return NULL;
 }
 
 reservation* resVect_get( resVect* v, int index )
@@ -158,37 +590,306 @@ reservation* resVect_get( resVect* v, int index )
 	return temp;
 }
 
+// Index of the reservation with the same room and times as res, or -1
+int resVect_find( resVect* v, reservation* res )
+{
+	resVect_need_index( v );
+	int roomid = resVect_room( v, res->roomname, 0 );
+	if( roomid < 0 )
+		return -1;
+
+	resNode* n = resTree_lower_bound( &v->rooms[roomid].schedule, &res->starttime, tree_start_key_cmp );
+	for( ; n && v->starts[n->slot] == res->starttime; n = resTree_next( n ) )
+	{
+		if( v->ends[n->slot] == res->endtime )
+			return n->slot;
+	}
+	return -1;
+}
+
 void resVect_delete( resVect* v, int index )
 {
+	RES_STAT_TIMER( STAT_DELETE );
 	if( index >= v->count || index < 0 )	// REQ6
 	{
 		fprintf( stderr, "%s:%d: index out of bounds with index %i.\n", __FUNCTION__, __LINE__, index );
 		snprintf( RES_ERROR_STR, BUFF, "Error deleting a reservation. Quitting the program." );
 		exit(1);
 	}
-	for( int i = index; i < v->count - 1; i++ )
+	resVect_need_index( v );
+	if( v->journal )
+		resJournal_log( v->journal, JOURNAL_DELETE, &v->data[index], NULL );
+	resVect_unindex_slot( v, index );
+	free( v->nodes[index] );		// REQ4
+	free( v->timenodes[index] );	// REQ4
+	free( v->daynodes[index] );		// REQ4
+
+	// Fill the hole with the last reservation; its index nodes just change slot
+	int last = v->count - 1;
+	if( index != last )
 	{
-		v->data[i] = v->data[i+1];
+		resWords_move( &v->words, last, index );
+		v->data[index] = v->data[last];
+		v->roomids[index] = v->roomids[last];
+		v->starts[index] = v->starts[last];
+		v->ends[index] = v->ends[last];
+		v->nodes[index] = v->nodes[last];
+		v->nodes[index]->slot = index;
+		v->timenodes[index] = v->timenodes[last];
+		v->timenodes[index]->slot = index;
+		v->startdays[index] = v->startdays[last];
+		v->enddays[index] = v->enddays[last];
+		v->daynodes[index] = v->daynodes[last];
+		v->daynodes[index]->slot = index;
 	}
 	v->count--;
 }
 
+static void resVect_append_series( resVect* v, resRecur* series, int roomid )
+{
+	if( v->seriescount == v->seriessize )
+	{
+		v->seriessize = v->seriessize ? v->seriessize * 2 : 5;
+		v->series = realloc( v->series, sizeof(resRecur) * v->seriessize );		// REQ4
+		v->seriesrooms = realloc( v->seriesrooms, sizeof(int) * v->seriessize );	// REQ4
+		if( !v->series || !v->seriesrooms )	// REQ6
+		{
+			ERROR_RES( stderr, "Error allocating memory for a recurring reservation" );
+			snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
+			exit(1);
+		}
+	}
+
+	resRoom* room = &v->rooms[roomid];
+	if( room->seriescount == room->seriessize )
+	{
+		room->seriessize = room->seriessize ? room->seriessize * 2 : 2;
+		room->series = realloc( room->series, sizeof(int) * room->seriessize );	// REQ4
+		if( !room->series )	// REQ6
+		{
+			ERROR_RES( stderr, "Error allocating memory for a recurring reservation" );
+			snprintf( RES_ERROR_STR, BUFF, "Error adding a reservation. Quitting the program." );
+			exit(1);
+		}
+	}
+	room->series[room->seriescount++] = v->seriescount;
+	v->series[v->seriescount] = *series;
+	v->seriesrooms[v->seriescount++] = roomid;
+}
+
+// Points the entry for series id from in a room's series list at id to, or drops it when to is -1
+static void room_move_series( resVect* v, int roomid, int from, int to )
+{
+	resRoom* room = &v->rooms[roomid];
+	for( int j = 0; j < room->seriescount; j++ )
+	{
+		if( room->series[j] != from )
+			continue;
+		if( to < 0 )
+			room->series[j] = room->series[--room->seriescount];
+		else
+			room->series[j] = to;
+		return;
+	}
+}
+
+/***
+ * Adds a recurring series unless one of its occurrences overlaps a
+ * reservation or an occurrence of another series in the same room. Each
+ * occurrence is checked like a single reservation would be, and the series
+ * already stored answer from their rules. Returns the reservation or
+ * occurrence in the way, or NULL once the series is added.
+ */
+reservation* resVect_add_series( resVect* v, resRecur* series )	// REQ7
+{
+	RES_STAT_TIMER( STAT_ADD_SERIES );
+	resVect_need_index( v );
+	int roomid = resVect_room( v, series->first.roomname, 1 );
+
+	for( int k = 0; k < series->count; k++ )
+	{
+		if( resRecur_skipped( series, k ) )
+			continue;
+		reservation occurrence = resRecur_occurrence( series, k );
+		reservation* check = room_conflict( v, roomid, &occurrence );	// REQ7
+		if( check )
+		{
+			RES_STAT_FAILED();
+			return check;
+		}
+	}
+
+	if( v->journal )
+		resJournal_log_series( v->journal, JOURNAL_SERIES_ADD, series );
+	resVect_append_series( v, series, roomid );
+	return NULL;
+}
+
+// The series whose first occurrence is first, or -1
+int resVect_find_series( resVect* v, reservation* first )
+{
+	// Only the series of first's room are looked at, so no names are compared
+	int roomid = resVect_room( v, first->roomname, 0 );
+	if( roomid < 0 )
+		return -1;
+
+	resRoom* room = &v->rooms[roomid];
+	for( int j = 0; j < room->seriescount; j++ )
+	{
+		reservation* f = &v->series[room->series[j]].first;
+		if( f->starttime == first->starttime && f->endtime == first->endtime )
+			return room->series[j];
+	}
+	return -1;
+}
+
+// Leaves occurrence k out of a series; returns -1 if there is no such occurrence or no room for another exception
+int resVect_skip_occurrence( resVect* v, int series, int k )
+{
+	if( series < 0 || series >= v->seriescount || resRecur_skip( &v->series[series], k ) != 0 )
+		return -1;
+	if( v->journal )
+		resJournal_log_series( v->journal, JOURNAL_SERIES_UPDATE, &v->series[series] );
+	return 0;
+}
+
+void resVect_delete_series( resVect* v, int series )
+{
+	if( series >= v->seriescount || series < 0 )	// REQ6
+	{
+		fprintf( stderr, "%s:%d: index out of bounds with index %i.\n", __FUNCTION__, __LINE__, series );
+		snprintf( RES_ERROR_STR, BUFF, "Error deleting a reservation. Quitting the program." );
+		exit(1);
+	}
+	if( v->journal )
+		resJournal_log_series( v->journal, JOURNAL_SERIES_DELETE, &v->series[series] );
+
+	// Like reservations, the last series moves into the hole, and its room hears of its new id
+	room_move_series( v, v->seriesrooms[series], series, -1 );
+	v->seriescount--;
+	if( series != v->seriescount )
+		room_move_series( v, v->seriesrooms[v->seriescount], v->seriescount, series );
+	v->series[series] = v->series[v->seriescount];
+	v->seriesrooms[series] = v->seriesrooms[v->seriescount];
+}
+
+// Loads the series saved beside a schedule file, if there are any
+void resVect_read_series( resVect* v, char* filename )	// REQ3b
+{
+	char seriesname[BUFF];
+	snprintf( seriesname, BUFF, "%s.series", filename );
+
+	FILE* fp;
+	if( (fp = fopen( seriesname, "r" )) == NULL )
+		return;
+
+	resRecur series;
+	while( fread( &series, sizeof(resRecur), 1, fp ) == 1 )	// REQ3a
+	{
+		series.first.roomname[ROOM_NAME_LEN - 1] = '\0';
+		resVect_append_series( v, &series, resVect_room( v, series.first.roomname, 1 ) );
+	}
+	if( ferror( fp ) )	// REQ6
+	{
+		ERROR_RES( stderr, "Short read of recurring reservations: fread" );
+		snprintf( RES_ERROR_STR, BUFF, "Error reading reservations. Quitting the program." );
+		exit(1);
+	}
+	fclose( fp );
+}
+
 void resVect_free( resVect* v )	// REQ4
 {
-	if( v->data )
+	for( int i = 0; i < v->roomcount; i++ )
+	{
+		resTree_free( &v->rooms[i].schedule );
+		if( v->rooms[i].series )
+			free( v->rooms[i].series );
+	}
+	resTree_free( &v->timeline );
+	resTree_free( &v->days );
+	resWords_free( &v->words );
+	resAvail_free( &v->avail );
+	if( v->rooms )
+		free( v->rooms );
+	if( v->roomorder )
+		free( v->roomorder );
+	if( v->roomids )
+		free( v->roomids );
+	if( v->starts )
+		free( v->starts );
+	if( v->ends )
+		free( v->ends );
+	if( v->nodes )
+		free( v->nodes );
+	if( v->timenodes )
+		free( v->timenodes );
+	if( v->startdays )
+		free( v->startdays );
+	if( v->enddays )
+		free( v->enddays );
+	if( v->daynodes )
+		free( v->daynodes );
+	if( v->series )
+		free( v->series );
+	if( v->seriesrooms )
+		free( v->seriesrooms );
+	if( v->mapped )
+		munmap( v->data, v->mapped );
+	else if( v->data )
 		free( v->data );
 }
 
-void resVect_write_file( resVect* v, char* filename )	// REQ10
+static int write_records( const char* filename, const void* records, size_t size, int count )	// REQ10
 {
+	// Write beside the old file and rename over it; the old file may still be mapped at v->data
+	char tmpname[BUFF];
+	snprintf( tmpname, BUFF, "%s.tmp", filename );
+
 	FILE* fp;
-	fp = fopen( filename, "w" );
-	fwrite( v->data, sizeof(reservation), v->count, fp );
+	if( (fp = fopen( tmpname, "w" )) == NULL )	// REQ6
+	{
+		ERROR_RES( stderr, "Cannot open file for saving reservations" );
+		return -1;
+	}
+	if( fwrite( records, size, count, fp ) != count || fflush( fp ) != 0 || fsync( fileno( fp ) ) != 0 )	// REQ6
+	{
+		ERROR_RES( stderr, "Short write saving reservations" );
+		fclose( fp );
+		unlink( tmpname );
+		return -1;
+	}
 	fclose( fp );
+
+	if( rename( tmpname, filename ) != 0 )	// REQ6
+	{
+		ERROR_RES( stderr, "rename saved reservations" );
+		return -1;
+	}
+	return 0;
+}
+
+// Saves the reservations to filename and any recurring series to filename.series
+int resVect_write_file( resVect* v, char* filename )	// REQ10
+{
+	RES_STAT_TIMER( STAT_WRITE_FILE );
+	char seriesname[BUFF];
+	snprintf( seriesname, BUFF, "%s.series", filename );
+
+	if( v->seriescount )
+	{
+		if( write_records( seriesname, v->series, sizeof(resRecur), v->seriescount ) != 0 )
+			return -1;
+	} else if( unlink( seriesname ) != 0 && errno != ENOENT ) {	// REQ6
+		ERROR_RES( stderr, "remove saved series" );
+		return -1;
+	}
+	return write_records( filename, v->data, sizeof(reservation), v->count );
 }
 
 void resVect_read_file( resVect* v, char* filename )	// REQ3b
 {
+	RES_STAT_TIMER( STAT_READ_FILE );
 	FILE* fp;
 	if( (fp = fopen( filename, "r")) == NULL )	// REQ6
 	{
@@ -228,328 +929,961 @@ void resVect_read_file( resVect* v, char* filename )	// REQ3b
 
 	}
 
-	qsort( v->data, v->count, sizeof(reservation), sort_name_time );	// REQ5
 	fclose( fp );
+	v->indexed = 0;
+	resVect_need_index( v );
 }
 
-void resVect_check_consistency( resVect* v, char** rooms, int numrooms )	// REQ8
+void resVect_map_file( resVect* v, char* filename )	// REQ3b
 {
-	char** checkname;
+	RES_STAT_TIMER( STAT_MAP_FILE );
+	int fd;
+	if( (fd = open( filename, O_RDONLY )) < 0 )	// REQ6
+	{
+		fprintf( stderr, "Cannot open file: %s for reading reservations. One may be created.\n", filename );
+		return;
+	}
 
-	for( int i = 0; i < v->count; i++ )
+	struct stat st;
+	if( fstat( fd, &st ) != 0 )	// REQ6
 	{
-		checkname = bsearch( v->data[i].roomname, rooms, numrooms, sizeof(char*), bsearch_room_cmp );	// REQ5, REQ8
+		ERROR_RES( stderr, "fstat reservation file" );
+		snprintf( RES_ERROR_STR, BUFF, "Error reading reservations. Quitting the program." );
+		exit(1);
+	}
 
-		if( checkname == NULL )		// REQ6
+	int count = st.st_size / sizeof(reservation);
+	if( count == 0 )
+	{
+		close( fd );
+		return;
+	}
+
+	/*
+	 * Reserve private anonymous address space with room to grow, then map the file over
+	 * the front of it. Pages are only read in when a record is touched and only copied
+	 * when a record is written, and new reservations land in the anonymous tail.
+	 */
+	int capacity = count * 2 + 1024;
+	size_t length = sizeof(reservation) * capacity;
+	void* base = mmap( NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( base == MAP_FAILED || mmap( base, sizeof(reservation) * count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED )	// REQ6
+	{
+		ERROR_RES( stderr, "mmap reservation file" );
+		snprintf( RES_ERROR_STR, BUFF, "Error reading reservations. Quitting the program." );
+		exit(1);
+	}
+	close( fd );
+
+	v->data = base;
+	v->mapped = length;
+	v->size = capacity;
+	v->count = count;
+	v->indexed = 0;
+}
+
+static void resVect_check_rooms( resVect* v )	// REQ8
+{
+	if( !v->checkrooms )
+		return;
+
+	// Every room in rooms.dat was interned up front, so anything past those ids is unknown
+	for( int i = 0; i < v->count; i++ )
+	{
+		if( v->roomids[i] >= v->internedrooms )		// REQ6
 		{
 			fprintf( stderr, "%s:%d: File incosistency. %s is missing from rooms.dat\n", __FUNCTION__, __LINE__, v->data[i].roomname );
 			snprintf( RES_ERROR_STR, BUFF, "Inconsistent data in the reservation file. Quitting the program." );
 			exit(1);		
 		}
 	}
+	for( int i = 0; i < v->seriescount; i++ )
+	{
+		if( v->seriesrooms[i] >= v->internedrooms )		// REQ6
+		{
+			fprintf( stderr, "%s:%d: File incosistency. %s is missing from rooms.dat\n", __FUNCTION__, __LINE__, v->series[i].first.roomname );
+			snprintf( RES_ERROR_STR, BUFF, "Inconsistent data in the reservation file. Quitting the program." );
+			exit(1);
+		}
+	}
 }
 
-size_t* resVect_select_room_at_time( resVect* v, time_t key, char** rooms, int numrooms )
+void resVect_check_consistency( resVect* v, char** rooms, int numrooms )	// REQ8
 {
-	qsort( v->data, v->count, sizeof(reservation), sort_time_name );	// REQ5
-	time_t timekey = to_utc( key );
+	if( v->roomnames != rooms )
+		resVect_set_rooms( v, rooms, numrooms );
+	v->checkrooms = 1;
 
+	// A mapped schedule is checked when its index is first needed so startup stays cheap
+	if( v->indexed )
+		resVect_check_rooms( v );
+}
 
-	int index = 0;
-	size_t reservedrooms[numrooms];
-	reservation* reserved;
-	reserved = bsearch( &timekey, v->data, v->count, sizeof(reservation), bsearch_time_cmp );	// REQ5
+void resQuery_init( resQuery* q )
+{
+	memset( q, 0, sizeof(resQuery) );
+}
 
-	size_t room_address;
-	size_t res_address;
-	size_t* available = NULL;
-	if( reserved != NULL ) {
-		char** foundroom = bsearch( reserved->roomname, rooms, numrooms, sizeof(char*), bsearch_room_cmp );	// REQ5
-		room_address = foundroom - rooms;
-		res_address = reserved - v->data;
-		reservedrooms[index++] = room_address;
-
-		/*
-		 * Bsearch is used on each room reservation that contains the given time key. This is to determine
-		 * the address in the rooms array to appropriately show the available rooms at the end.
-		 */
-
-		// Go left
-		size_t lefti = res_address - 1;
-		while( lefti >= 0 && timekey >= v->data[lefti].starttime && timekey <= v->data[lefti].endtime )
+// Drops the buffers; ones from an arena are left for its reset, and the query stays on that arena
+void resQuery_free( resQuery* q )	// REQ4
+{
+	resArena* arena = q->arena;
+	if( !arena )
+	{
+		free( q->hits );
+		free( q->slots );
+		free( q->occurrences );
+		free( q->scratch );
+	}
+	resQuery_init( q );
+	q->arena = arena;
+}
+
+// Grows buffer to hold at least count elements, doubling from 5 like the selects always have
+static void* query_reserve( resArena* arena, void* buffer, int* size, int count, size_t elemsize )
+{
+	if( count <= *size )
+		return buffer;
+
+	int grown = *size ? *size : 5;
+	while( grown < count )
+		grown *= 2;
+	if( arena )
+		buffer = resArena_grow( arena, buffer, elemsize * *size, elemsize * grown );
+	else
+		buffer = realloc( buffer, elemsize * grown );	// REQ4
+	if( !buffer )	// REQ6
+	{
+		fputs( "Error allocating memory to return search results.", stderr );
+		snprintf( RES_ERROR_STR, BUFF, "Error retrieving reservations. Quitting the program." );
+		exit(1);
+	}
+	*size = grown;
+	return buffer;
+}
+
+// Working space of at least bytes; what was in it before is not kept
+static void* query_scratch( resQuery* q, size_t bytes )
+{
+	if( bytes > q->scratchsize )
+	{
+		if( q->arena )
 		{
-			foundroom = bsearch( v->data[lefti].roomname, rooms, numrooms, sizeof(char*), bsearch_room_cmp );	// REQ5
-			room_address = foundroom - rooms;
-			reservedrooms[index++] = room_address;			
-			lefti--;
+			q->scratch = resArena_alloc( q->arena, bytes );
+			q->scratchsize = bytes;
+			return q->scratch;
 		}
-
-		// Go right
-		size_t righti = res_address + 1;
-		while( righti < v->count && timekey >= v->data[righti].starttime && timekey <= v->data[righti].endtime )
+		free( q->scratch );
+		q->scratch = malloc( bytes );	// REQ4
+		if( !q->scratch )	// REQ6
 		{
-			foundroom = bsearch( v->data[righti].roomname, rooms, numrooms, sizeof(char*), bsearch_room_cmp );	// REQ5
-			room_address = foundroom - rooms;
-			reservedrooms[index++] = room_address;
-			righti++;
+			fputs( "Error allocating memory to search reservations.", stderr );
+			snprintf( RES_ERROR_STR, BUFF, "Error retrieving reservations. Quitting the program." );
+			exit(1);
 		}
+		q->scratchsize = bytes;
+	}
+	return q->scratch;
+}
+
+// Hands the hits of a one-off query to the caller the way the selects return them
+static size_t* take_hits( resQuery* q, int count )
+{
+	size_t* hits = NULL;
+	if( count )
+	{
+		hits = q->hits;
+		q->hits = NULL;
+	}
+	resQuery_free( q );
+	res_lookup_size = count;
+	return hits;
+}
+
+/***
+ * Puts the indices into rooms of the rooms with nothing reserved during
+ * [start, end] in q->hits and returns how many there are. The
+ * availability bitmaps settle most rooms a machine word at a time; only
+ * rooms they leave unsure get a search of their schedule.
+ */
+static int rooms_free_between( resVect* v, resQuery* q, time_t start, time_t end, char** rooms, int numrooms )
+{
+	int words = v->avail.words;
+	q->hits = query_reserve( q->arena, q->hits, &q->hitsize, numrooms, sizeof(size_t) );
+	availWord* freebits = query_scratch( q, sizeof(availWord) * words * 2 + v->roomcount );
+	availWord* unsure = freebits + words;
+	char* seriesbusy = (char*)(unsure + words);
 
-		qsort( reservedrooms, index, sizeof(size_t), sort_int );	// REQ5
-		available = calloc( (numrooms - index), sizeof(size_t) );	// REQ4
-		if( !available )	// REQ6
+	if( !resAvail_free_between( &v->avail, start, end, freebits, unsure ) )
+	{
+		// The bitmaps don't reach this far; ask every room schedule instead
+		for( int w = 0; w < words; w++ )
 		{
-			fputs( "Error allocating memory to return available rooms.", stderr );
-			snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations. Quitting the program." );
-			exit(1);
+			freebits[w] = 0;
+			unsure[w] = ~(availWord)0;
 		}
+	}
 
-		int avail_index = 0;
-		for( size_t i = 0; i < numrooms; i++ )
+	for( int w = 0; w < words; w++ )
+	{
+		for( availWord bits = unsure[w]; bits; bits &= bits - 1 )
 		{
-			if( bsearch( &i, reservedrooms, index, sizeof(size_t), sort_size_t ) == NULL )	// REQ5
-				available[avail_index++] = i;
+			int roomid = w * AVAIL_WORD_BITS + __builtin_ctzl( bits );
+			if( roomid < v->roomcount && !room_reserved_between( v, roomid, start, end ) )
+				freebits[w] |= (availWord)1 << (roomid % AVAIL_WORD_BITS);
+		}
+	}
 
+	// Recurring series aren't in the bitmaps; each one is asked once from its rule
+	if( v->seriescount )
+	{
+		memset( seriesbusy, 0, v->roomcount );
+		// Widening by a second each way turns the overlap test into one that counts touching ends
+		for( int i = 0; i < v->seriescount; i++ )
+		{
+			if( resRecur_overlap( &v->series[i], start - 1, end + 1 ) >= 0 )
+				seriesbusy[v->seriesrooms[i]] = 1;
 		}
-		res_lookup_size = avail_index;
 	}
 
+	// With the interned rooms.dat table, room id i is rooms[i] and no names are compared
+	int avail_index = 0;
+	for( int i = 0; i < numrooms; i++ )
+	{
+		int roomid = rooms == v->roomnames ? i : resVect_room( v, rooms[i], 0 );
+		if( roomid >= 0 && v->seriescount && seriesbusy[roomid] )
+			continue;
+		if( roomid < 0 || roomid >= words * AVAIL_WORD_BITS || (freebits[roomid / AVAIL_WORD_BITS] >> (roomid % AVAIL_WORD_BITS) & 1) )
+			q->hits[avail_index++] = i;
+	}
+	return avail_index;
+}
+
+int resVect_query_room_at_time( resVect* v, resQuery* q, time_t key, char** rooms, int numrooms )
+{
+	RES_STAT_TIMER( STAT_ROOM_AT_TIME );
+	resVect_need_index( v );
+	time_t timekey = to_utc( key );	// REQ11
+	return rooms_free_between( v, q, timekey, timekey, rooms, numrooms );
+}
+
+// Rooms free at key, or NULL if nothing is reserved then and every room is free
+size_t* resVect_select_room_at_time( resVect* v, time_t key, char** rooms, int numrooms )
+{
+	resQuery q;
+	resQuery_init( &q );
+	int count = resVect_query_room_at_time( v, &q, key, rooms, numrooms );
+
+	// With every room reserved the answer is an empty array, not NULL
+	size_t* available = NULL;
+	if( count < numrooms )
+	{
+		available = q.hits;
+		q.hits = NULL;
+	}
+	resQuery_free( &q );
+	res_lookup_size = count;
 	return available;
 }
 
-size_t* resVect_select_res_day( resVect* v, time_t key )
+int resVect_query_free_rooms( resVect* v, resQuery* q, time_t start, time_t end, char** rooms, int numrooms )
+{
+	RES_STAT_TIMER( STAT_FREE_ROOMS );
+	resVect_need_index( v );
+	return rooms_free_between( v, q, to_utc( start ), to_utc( end ), rooms, numrooms );	// REQ11
+}
+
+// Rooms free for the whole of [start, end], or NULL if every room is taken at some point
+size_t* resVect_select_free_rooms( resVect* v, time_t start, time_t end, char** rooms, int numrooms )
+{
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_free_rooms( v, &q, start, end, rooms, numrooms ) );
+}
+
+typedef struct Range_Hits {
+	resQuery* q;
+	int count;
+} rangeHits;
+
+static void range_hit( void* arg, int slot )
 {
-	qsort( v->data, v->count, sizeof(reservation), sort_time_name );	// REQ5
+	rangeHits* hits = (rangeHits*)arg;
+	resQuery* q = hits->q;
+	q->hits = query_reserve( q->arena, q->hits, &q->hitsize, hits->count + 1, sizeof(size_t) );
+	q->hits[hits->count++] = slot;
+}
 
-	int day_count = 0;
-	int day_size = 5;
-	size_t* res_on_day = NULL;
-	reservation* res = NULL;
+// Earliest stored time that can fall on a local day; a day number takes the offset twice, each under a day
+static time_t day_floor( int day )
+{
+	return (time_t)(day - 3) * 24 * 60 * 60;
+}
 
-	res = bsearch( &key, v->data, v->count, sizeof(reservation), bsearch_day_cmp );	// REQ5
+// Whether [start, end] meets a local day, worked out like the start and end days of the days tree
+static int on_day( time_t start, time_t end, int day )
+{
+	return res_local_day( to_local( start ) ) <= day && res_local_day( to_local( end ) ) >= day;
+}
 
-	size_t res_index;
-	if( res ) {
-		res_on_day = calloc( day_size, sizeof(size_t) );	// REQ4
-		if( !res_on_day )	// REQ6
+/***
+ * Collects the occurrences of every series overlapping [from, to] (stored
+ * times, ends included) into q->occurrences, in start order, and returns
+ * how many. With day >= 0 only those on that local day are kept. Only the
+ * occurrences inside the range are worked out.
+ */
+static int occurrences_between( resVect* v, resQuery* q, time_t from, time_t to, int day )
+{
+	int count = 0;
+	for( int i = 0; i < v->seriescount; i++ )
+	{
+		resRecur* r = &v->series[i];
+		for( int k = resRecur_first_ending_after( r, from - 1 ); k < r->count && resRecur_start( r, k ) <= to; k++ )
 		{
-			fputs( "Error allocating memory to return reservations on a particular day.", stderr );
-			snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations on a particular day. Quitting the program." );
-			exit(1);
+			if( resRecur_skipped( r, k ) || (day >= 0 && !on_day( resRecur_start( r, k ), resRecur_end( r, k ), day )) )
+				continue;
+			q->occurrences = query_reserve( q->arena, q->occurrences, &q->occurrencesize, count + 1, sizeof(resOccurrence) );
+			q->occurrences[count].series = i;
+			q->occurrences[count].k = k;
+			q->occurrences[count++].res = resRecur_occurrence( r, k );
 		}
-		res_index = res - v->data;
-		res_on_day[day_count++] = res_index;
-
-		// Go left
-		time_t res_t;
-		struct tm res_tm;
-		struct tm day_key_tm;
-		localtime_r( &key, &day_key_tm );	// REQ11
-		size_t lefti = res_index - 1;
-		while( lefti >= 0 )
-		{
-			if( res_index == 0 )	// Forgot size_t can't be negative, this prevents -1 indexing when getting reservations
-				break;
-
-			res_t = v->data[lefti].starttime;
-			res_t = to_local( res_t );
-			localtime_r( &res_t, &res_tm );
-
-			if( res_tm.tm_wday != day_key_tm.tm_wday )
-				break;
-
-			if( day_count == day_size )
-			{
-				day_size *= 2;
-				res_on_day = realloc( res_on_day, sizeof(size_t) * day_size );	// REQ4
-				if( !res_on_day )	// REQ6
-				{
-					fputs( "Error reallocating memory to return reservations on a particular day.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations on a particular day. Quitting the program." );
-					exit(1);	
-				}
-			}
+	}
+	sort_in_place( q->occurrences, count, sizeof(resOccurrence), sort_occurrence_start );	// REQ5
+	q->occurrencecount = count;
+	return count;
+}
 
-			res_on_day[day_count++] = lefti;
-			if( lefti == 0 )	// Forgot size_t can't be negative, this prevents -1 indexing when getting reservations
-				break;
-			else		
-				lefti--;
-		}
+/***
+ * Reservations of any room overlapping [start, end] (ends included, as in
+ * resVect_select_free_rooms), in timeline order. The timeline keeps the
+ * latest end of every subtree, so only the part of it that can reach the
+ * range is walked. Returns how many are in q->hits; the series occurrences
+ * in the range are left in q->occurrences, q->occurrencecount of them.
+ */
+int resVect_query_res_range( resVect* v, resQuery* q, time_t start, time_t end )
+{
+	RES_STAT_TIMER( STAT_RES_RANGE );
+	resVect_need_index( v );
+
+	time_t from = to_utc( start );		// REQ11
+	time_t to = to_utc( end );
+	rangeHits hits = { q, 0 };
+	resTree_overlaps( &v->timeline, from, &to, tree_start_key_cmp, range_hit, &hits );	// REQ5
+	occurrences_between( v, q, from, to, -1 );
+	return hits.count;
+}
+
+size_t* resVect_select_res_range( resVect* v, time_t start, time_t end )
+{
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_res_range( v, &q, start, end ) );
+}
+
+// Occurrences of every recurring series overlapping [start, end] (ends included, as in resVect_select_res_range), in start order
+int resVect_query_occurrences( resVect* v, resQuery* q, time_t start, time_t end )
+{
+	RES_STAT_TIMER( STAT_OCCURRENCES );
+	return occurrences_between( v, q, to_utc( start ), to_utc( end ), -1 );	// REQ11
+}
+
+resOccurrence* resVect_select_occurrences( resVect* v, time_t start, time_t end )
+{
+	resQuery q;
+	resQuery_init( &q );
+	int count = resVect_query_occurrences( v, &q, start, end );
+	resOccurrence* found = NULL;
+	if( count )
+	{
+		found = q.occurrences;
+		q.occurrences = NULL;
+	}
+	resQuery_free( &q );
+	res_lookup_size = count;
+	return found;
+}
+
+typedef struct Gap_Cursor {
+	time_t from;			// Earliest start still to try in this room
+	resNode* next;			// First reservation of the room ending after from
+	int room;				// Index into the rooms searched
+	int roomid;				// -1 for a room with no schedule
+} gapCursor;
 
-		// Go right
-		size_t righti = res_index + 1;
-		while( righti < v->count )
+// Earliest occurrence of a room's recurring series ending after t; returns 0 if there is none
+static int series_next_busy( resVect* v, int roomid, time_t t, time_t* start, time_t* end )
+{
+	if( roomid < 0 )
+		return 0;
+
+	int found = 0;
+	resRoom* room = &v->rooms[roomid];
+	for( int j = 0; j < room->seriescount; j++ )
+	{
+		resRecur* r = &v->series[room->series[j]];
+		int k = resRecur_first_ending_after( r, t );
+		while( k < r->count && resRecur_skipped( r, k ) )
+			k++;
+		if( k < r->count && (!found || resRecur_start( r, k ) < *start) )
 		{
-			res_t = v->data[righti].starttime;
-			res_t = to_local( res_t );
-			localtime_r( &res_t, &res_tm );
-
-			if( res_tm.tm_wday != day_key_tm.tm_wday )
-				break;
-
-			if( day_count == day_size )
-			{
-				day_size *= 2;
-				res_on_day = realloc( res_on_day, sizeof(size_t) * day_size );	// REQ4
-				if( !res_on_day )	// REQ6
-				{
-					fputs( "Error reallocating memory to return reservations on a particular day.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations on a particular day. Quitting the program." );
-					exit(1);	
-				}
-			}
+			*start = resRecur_start( r, k );
+			*end = resRecur_end( r, k );
+			found = 1;
+		}
+	}
+	return found;
+}
 
-			res_on_day[day_count++] = righti;
-			righti++;
+/***
+ * Moves a room's cursor to the first gap of at least duration starting at
+ * or after c->from. Returns 0 if no such gap ends by end. Ends touching
+ * starts are fine, the same as for resVect_add.
+ */
+static int room_next_gap( resVect* v, gapCursor* c, time_t end, time_t duration )
+{
+	time_t busystart, busyend;
+	do {
+		for( ; c->next && v->starts[c->next->slot] < c->from + duration; c->next = resTree_next( c->next ) )
+		{
+			if( v->ends[c->next->slot] > c->from )
+				c->from = v->ends[c->next->slot];
 		}
+		if( v->seriescount && series_next_busy( v, c->roomid, c->from, &busystart, &busyend ) && busystart < c->from + duration )
+			c->from = busyend;
+		else
+			break;
+	} while( c->from + duration <= end );
+	return c->from + duration <= end;
+}
+
+static int gap_before( gapCursor* left, gapCursor* right )
+{
+	return left->from < right->from || (left->from == right->from && left->room < right->room);
+}
+
+static void gap_sift_down( gapCursor* heap, int count, int i )
+{
+	for( ;; )
+	{
+		int least = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+		if( l < count && gap_before( &heap[l], &heap[least] ) )
+			least = l;
+		if( r < count && gap_before( &heap[r], &heap[least] ) )
+			least = r;
+		if( least == i )
+			return;
+		gapCursor tmp = heap[i];
+		heap[i] = heap[least];
+		heap[least] = tmp;
+		i = least;
+	}
+}
+
+// Gives every room a cursor at from; the rooms with a gap before to make up the heap, whose size is returned
+static int gaps_open( resVect* v, gapCursor* heap, time_t from, time_t to, time_t duration, char** rooms, int numrooms )
+{
+	int count = 0;
+	for( int i = 0; i < numrooms; i++ )
+	{
+		int roomid = rooms == v->roomnames ? i : resVect_room( v, rooms[i], 0 );
+		heap[count].from = from;
+		heap[count].next = roomid >= 0 ? resTree_upper_bound( &v->rooms[roomid].schedule, &from, tree_end_key_cmp ) : NULL;	// REQ5
+		heap[count].room = i;
+		heap[count].roomid = roomid;
+		if( duration > 0 && room_next_gap( v, &heap[count], to, duration ) )
+			count++;
+	}
+	for( int i = count / 2 - 1; i >= 0; i-- )
+		gap_sift_down( heap, count, i );
+	return count;
+}
 
-		qsort( res_on_day, day_count, sizeof(size_t), sort_int );	// REQ5
+// Takes the earliest gap on the heap as slot and moves its room on to the next one; returns the new heap size
+static int gaps_next( resVect* v, gapCursor* heap, int count, time_t to, time_t duration, resFreeSlot* slot )
+{
+	gapCursor* c = &heap[0];
+	slot->room = c->room;
+	slot->start = to_local( c->from );	// REQ11
+	slot->end = to_local( c->from + duration );
+
+	// The gap just used runs until the next reservation or occurrence, so the room's next gap starts after that
+	time_t busystart, busyend;
+	int more = 1;
+	if( v->seriescount && series_next_busy( v, c->roomid, c->from, &busystart, &busyend ) && (!c->next || busystart < v->starts[c->next->slot]) )
+		c->from = busyend;
+	else if( c->next ) {
+		c->from = v->ends[c->next->slot];
+		c->next = resTree_next( c->next );
+	} else
+		more = 0;
+	if( !more || !room_next_gap( v, c, to, duration ) )
+		heap[0] = heap[--count];
+	gap_sift_down( heap, count, 0 );
+	return count;
+}
+
+/***
+ * The earliest wanted free slots of the given length inside [start, end],
+ * at most one per gap, earliest first (ties by position in rooms). Every
+ * room keeps a cursor into its schedule that jumps from gap to gap, and a
+ * heap of the cursors picks the earliest; no time is probed on its own.
+ * The slots go in q->slots and their count is returned.
+ */
+int resVect_query_free_slots( resVect* v, resQuery* q, time_t start, time_t end, time_t duration, char** rooms, int numrooms, int wanted )
+{
+	RES_STAT_TIMER( STAT_FREE_SLOTS );
+	resVect_need_index( v );
+
+	time_t from = to_utc( start );	// REQ11
+	time_t to = to_utc( end );
+	gapCursor* heap = query_scratch( q, sizeof(gapCursor) * (numrooms ? numrooms : 1) );
+	q->slots = query_reserve( q->arena, q->slots, &q->slotsize, wanted, sizeof(resFreeSlot) );
+
+	int count = gaps_open( v, heap, from, to, duration, rooms, numrooms );
+	int found = 0;
+	while( count && found < wanted )
+		count = gaps_next( v, heap, count, to, duration, &q->slots[found++] );
+	return found;
+}
 
+// The same slots in a new array, or NULL if no room has one; res_lookup_size holds the count
+resFreeSlot* resVect_select_free_slots( resVect* v, time_t start, time_t end, time_t duration, char** rooms, int numrooms, int wanted )
+{
+	resQuery q;
+	resQuery_init( &q );
+	int count = resVect_query_free_slots( v, &q, start, end, duration, rooms, numrooms, wanted );
+	resFreeSlot* slots = NULL;
+	if( count )
+	{
+		slots = q.slots;
+		q.slots = NULL;
 	}
+	resQuery_free( &q );
+	res_lookup_size = count;
+	return slots;
+}
 
-	res_lookup_size = day_count;
-	return res_on_day;
+/***
+ * Reservations on the local calendar day holding key, in timeline order.
+ * The days tree is ordered by start day and keeps the latest end day of
+ * every subtree, so the walk skips whatever finished before the day and
+ * stops at the first reservation starting after it. Returns how many are
+ * in q->hits; the series occurrences on the day are left in
+ * q->occurrences, q->occurrencecount of them.
+ */
+int resVect_query_res_day( resVect* v, resQuery* q, time_t key )
+{
+	RES_STAT_TIMER( STAT_RES_DAY );
+	resVect_need_index( v );
+
+	int day = res_local_day( key );		// REQ11
+	rangeHits hits = { q, 0 };
+	resTree_overlaps( &v->days, day, &day, tree_day_key_cmp, range_hit, &hits );	// REQ5
+	occurrences_between( v, q, day_floor( day ), day_floor( day + 5 ), day );
+	return hits.count;
 }
 
-size_t* resVect_select_res_room( resVect* v, char* key )
+size_t* resVect_select_res_day( resVect* v, time_t key )
 {
-	qsort( v->data, v->count, sizeof(reservation), sort_name_time );	// REQ5
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_res_day( v, &q, key ) );
+}
 
+// Reservations of the room still running or upcoming, in start order
+int resVect_query_res_room( resVect* v, resQuery* q, char* key )
+{
+	RES_STAT_TIMER( STAT_RES_ROOM );
+	resVect_need_index( v );
 	time_t timeNow = time( NULL );
 	int resCount = 0;
-	int resSize = 5;
-	size_t* resRooms = NULL;
-	reservation* res = NULL;
 
-	res = bsearch( key, v->data, v->count, sizeof(reservation), bsearch_res_room_cmp );	// REQ5
+	int roomid = resVect_room( v, key, 0 );
+	if( roomid < 0 )
+		return 0;
 
-	size_t resIndex;
-	if( res )
+	// A room's reservations end in the same order they start, so the first one still
+	// running or upcoming is the first to end after now
+	resNode* n = resTree_upper_bound( &v->rooms[roomid].schedule, &timeNow, tree_end_key_cmp );
+	for( ; n; n = resTree_next( n ) )
 	{
-		resRooms = calloc( resSize, sizeof(size_t) );	// REQ4
-		if( !resRooms )		// REQ6
-		{
-			fputs( "Error allocating memory to return reservations for a particular room.", stderr );
-			snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations for a particular room. Quitting the program." );
-			exit(1);
-		}
+		q->hits = query_reserve( q->arena, q->hits, &q->hitsize, resCount + 1, sizeof(size_t) );
+		q->hits[resCount++] = n->slot;
+	}
+	return resCount;
+}
 
-		resIndex = res - v->data;
+size_t* resVect_select_res_room( resVect* v, char* key )
+{
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_res_room( v, &q, key ) );
+}
 
-		// Bsearch may find a reservation in the past.
-		// We must account for that and search for the first reservation that is occurring or will occur
-		// in the near future
-		while( resIndex < v->count && timeNow >= v->data[resIndex].endtime )
-		{
-			resIndex++;
-		}
+static int query_words( resVect* v, resQuery* q, char* key )
+{
+	resVect_need_index( v );
+
+	int count;
+	const int* hits = resWords_lookup( &v->words, key, &count );
+
+	q->hits = query_reserve( q->arena, q->hits, &q->hitsize, count, sizeof(size_t) );
+	for( int i = 0; i < count; i++ )
+		q->hits[i] = hits[i];
+	sort_in_place( q->hits, count, sizeof(size_t), sort_size_t );	// REQ5
+	return count;
+}
+
+int resVect_query_res_word( resVect* v, resQuery* q, char* key )
+{
+	RES_STAT_TIMER( STAT_RES_WORD );
+	return query_words( v, q, key );
+}
+
+size_t* resVect_select_res_word( resVect* v, char* key )
+{
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_res_word( v, &q, key ) );
+}
+
+int resVect_query_res_desc( resVect* v, resQuery* q, char* key )
+{
+	RES_STAT_TIMER( STAT_RES_DESC );
+	// Text can match inside a word ("oar" in "board"), which the word index can't answer, so this always scans
+	// The scan grows its list with realloc, which arena memory can't go through, so it gets room for every record
+	if( q->arena )
+		q->hits = query_reserve( q->arena, q->hits, &q->hitsize, v->count, sizeof(size_t) );
+
+	// Hits come back in index order, so no sort is needed
+	return desc_scan_into( v->data, v->count, key, &q->hits, &q->hitsize );
+}
+
+size_t* resVect_select_res_desc( resVect* v, char* key )
+{
+	resQuery q;
+	resQuery_init( &q );
+	return take_hits( &q, resVect_query_res_desc( v, &q, key ) );
+}
+
+#define CURSOR_SCAN_BLOCK 4096		// Records a description cursor scans per refill
+
+void resCursor_init( resCursor* c )
+{
+	memset( c, 0, sizeof(resCursor) );
+	resQuery_init( &c->q );
+}
 
-		// Check to make sure we still have a reservation with a room that the user is looking for
-		if( strcasecmp( key, v->data[resIndex].roomname ) != 0 )
+void resCursor_close( resCursor* c )	// REQ4
+{
+	resQuery_free( &c->q );
+	resCursor_init( c );
+}
+
+// Points c at a new search, keeping the buffers of the last one
+static void cursor_open( resCursor* c, resVect* v, int kind )
+{
+	c->v = v;
+	c->kind = kind;
+	c->limit = -1;
+	c->pos = 0;
+	c->count = 0;
+	c->node = NULL;
+	c->nextseries = -1;
+}
+
+// Finds the series holding the earliest occurrence still to hand out, leaving it in c->nextseries or -1; series are few, so each is looked at
+static void cursor_find_occurrence( resCursor* c )
+{
+	resVect* v = c->v;
+	int* next = c->q.scratch;
+	c->nextseries = -1;
+	for( int i = 0; i < v->seriescount; i++ )
+	{
+		resRecur* r = &v->series[i];
+		while( next[i] < r->count && (resRecur_skipped( r, next[i] ) || (c->kind == CURSOR_DAY && res_local_day( to_local( resRecur_end( r, next[i] ) ) ) < c->day)) )
+			next[i]++;
+		if( next[i] == r->count )
+			continue;
+
+		time_t start = resRecur_start( r, next[i] );
+		int inside = c->kind == CURSOR_DAY ? res_local_day( to_local( start ) ) <= c->day : start <= c->to;
+		if( inside && (c->nextseries < 0 || start < c->nextstart) )
 		{
-			return NULL;
+			c->nextseries = i;
+			c->nextstart = start;
 		}
+	}
+}
 
-		resRooms[resCount++] = resIndex;
-		
-		// Go left
-		size_t lefti = resIndex - 1;
-		while( lefti >= 0 )
-		{
-			if( resIndex == 0 )	// Forgot size_t can't be negative, this prevents -1 indexing when getting reservations
-				break;
+// Each series keeps the next occurrence to look at, from the first ending after after, in the scratch space
+static void cursor_open_series( resCursor* c, time_t after )
+{
+	resVect* v = c->v;
+	int* next = query_scratch( &c->q, sizeof(int) * (v->seriescount ? v->seriescount : 1) );
+	for( int i = 0; i < v->seriescount; i++ )
+		next[i] = resRecur_first_ending_after( &v->series[i], after );
+	cursor_find_occurrence( c );
+}
 
-			if( strcasecmp( key, v->data[lefti].roomname ) != 0 || timeNow >= v->data[lefti].endtime )
-			{
-				break;
-			}
-			if( resCount == resSize )
-			{
-				resSize *= 2;
-				resRooms = realloc( resRooms, sizeof(size_t) * resSize );	// REQ4
-				if( !resRooms )	// REQ6
-				{
-					fputs( "Error reallocating memory to return reservations for a particular room.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations for a particular room. Quitting the program." );
-					exit(1);	
-				}
-			}
+// Hands out the occurrence cursor_find_occurrence found and looks for the one after it
+static int cursor_take_occurrence( resCursor* c )
+{
+	int* next = c->q.scratch;
+	int series = c->nextseries;
+	c->occurrence.series = series;
+	c->occurrence.k = next[series]++;
+	c->occurrence.res = resRecur_occurrence( &c->v->series[series], c->occurrence.k );
+	cursor_find_occurrence( c );
+	return 1;
+}
 
-			resRooms[resCount++] = lefti;	
-			if( lefti == 0 )	// Forgot size_t can't be negative, this prevents -1 indexing when getting reservations
-				break;
-			else	
-				lefti--;
-		}
+// The free room searches settle every room at once from the bitmaps, so they are answered up front
+void resCursor_open_room_at_time( resCursor* c, resVect* v, time_t key, char** rooms, int numrooms )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_HITS );
+	time_t timekey = to_utc( key );	// REQ11
+	c->count = rooms_free_between( v, &c->q, timekey, timekey, rooms, numrooms );
+}
 
-		// Go right
-		size_t righti = resIndex + 1;
-		while( righti < v->count )
-		{
-			if( strcasecmp( key, v->data[righti].roomname ) != 0 )
-			{
-				break;
-			}
-			if( resCount == resSize )
-			{
-				resSize *= 2;
-				resRooms = realloc( resRooms, sizeof(size_t) * resSize );	// REQ4
-				if( !resRooms )	// REQ6
-				{
-					fputs( "Error reallocating memory to return reservations for a particular room.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations for a particular room. Quitting the program." );
-					exit(1);	
-				}
-			}
+void resCursor_open_free_rooms( resCursor* c, resVect* v, time_t start, time_t end, char** rooms, int numrooms )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_HITS );
+	c->count = rooms_free_between( v, &c->q, to_utc( start ), to_utc( end ), rooms, numrooms );	// REQ11
+}
 
-			resRooms[resCount++] = righti;
-			righti++;
-		}
+// The day and range searches hand out series occurrences too, merged in among the reservations
+void resCursor_open_res_day( resCursor* c, resVect* v, time_t key )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_DAY );
+	c->day = res_local_day( key );		// REQ11
+	c->node = resTree_first_ending( &v->days, c->day );	// REQ5
+	cursor_open_series( c, day_floor( c->day ) );
+}
+
+void resCursor_open_res_range( resCursor* c, resVect* v, time_t start, time_t end )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_RANGE );
+	c->from = to_utc( start );		// REQ11
+	c->to = to_utc( end );
+	c->node = resTree_first_ending( &v->timeline, c->from );
+	cursor_open_series( c, c->from - 1 );
+}
+
+void resCursor_open_occurrences( resCursor* c, resVect* v, time_t start, time_t end )
+{
+	cursor_open( c, v, CURSOR_OCCURRENCES );
+	c->from = to_utc( start );	// REQ11
+	c->to = to_utc( end );
+	cursor_open_series( c, c->from - 1 );
+}
+
+// As many slots as are pulled, rather than a wanted count
+void resCursor_open_free_slots( resCursor* c, resVect* v, time_t start, time_t end, time_t duration, char** rooms, int numrooms )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_SLOTS );
+	c->to = to_utc( end );	// REQ11
+	c->duration = duration;
+	gapCursor* heap = query_scratch( &c->q, sizeof(gapCursor) * (numrooms ? numrooms : 1) );
+	c->count = gaps_open( v, heap, to_utc( start ), c->to, duration, rooms, numrooms );
+}
+
+void resCursor_open_res_room( resCursor* c, resVect* v, char* key )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_ROOM );
+	time_t timeNow = time( NULL );
+	int roomid = resVect_room( v, key, 0 );
+	if( roomid >= 0 )
+		c->node = resTree_upper_bound( &v->rooms[roomid].schedule, &timeNow, tree_end_key_cmp );	// REQ5
+}
 
-		qsort( resRooms, resCount, sizeof(size_t), sort_int );	// REQ5
+static void hit_sift_down( size_t* heap, int count, int i )
+{
+	for( ;; )
+	{
+		int least = i;
+		int l = 2 * i + 1;
+		int r = l + 1;
+		if( l < count && heap[l] < heap[least] )
+			least = l;
+		if( r < count && heap[r] < heap[least] )
+			least = r;
+		if( least == i )
+			return;
+		size_t tmp = heap[i];
+		heap[i] = heap[least];
+		heap[least] = tmp;
+		i = least;
 	}
+}
 
-	res_lookup_size = resCount;
-	return resRooms;
+/***
+ * The word index keeps its slots unordered, so they are copied into a
+ * heap instead of sorted: building it is linear and each result pulled
+ * costs O(log n), so a first page doesn't pay for sorting the rest.
+ */
+void resCursor_open_res_word( resCursor* c, resVect* v, char* key )
+{
+	resVect_need_index( v );
+	cursor_open( c, v, CURSOR_WORD );
+
+	int count;
+	const int* hits = resWords_lookup( &v->words, key, &count );
+	c->q.hits = query_reserve( c->q.arena, c->q.hits, &c->q.hitsize, count, sizeof(size_t) );
+	for( int i = 0; i < count; i++ )
+		c->q.hits[i] = hits[i];
+	for( int i = count / 2 - 1; i >= 0; i-- )
+		hit_sift_down( c->q.hits, count, i );
+	c->count = count;
 }
 
-size_t* resVect_select_res_desc( resVect* v, char* key )
+// Descriptions are scanned a block of records at a time, as results are pulled
+void resCursor_open_res_desc( resCursor* c, resVect* v, char* key )
 {
-	int resCount = 0;
-	int resSize = 0;
-	size_t* resRooms = NULL;
-	for( size_t i = 0; i < v->count; i++)
+	cursor_open( c, v, CURSOR_DESC );
+
+	// With room for a whole block the scan never has to grow the list, which also keeps arena buffers safe
+	c->q.hits = query_reserve( c->q.arena, c->q.hits, &c->q.hitsize, CURSOR_SCAN_BLOCK, sizeof(size_t) );
+	strncpy( c->key, key, DESC_SIZE - 1 );
+	c->key[DESC_SIZE - 1] = '\0';
+	c->scanned = 0;
+}
+
+// Finds the next result, ignoring the limit; returns 0 once there are no more
+static int cursor_step( resCursor* c )
+{
+	resVect* v = c->v;
+	switch( c->kind )
 	{
-		if( strcasestr( v->data[i].description, key ) )
+	case CURSOR_HITS:
+		if( c->pos == c->count )
+			return 0;
+		c->hit = c->q.hits[c->pos++];
+		return 1;
+
+	case CURSOR_DAY:
+		if( c->node && v->startdays[c->node->slot] > c->day )
+			c->node = NULL;
+		// An occurrence starting before the next reservation goes first
+		if( c->nextseries >= 0 && (!c->node || c->nextstart < v->starts[c->node->slot]) )
+			return cursor_take_occurrence( c );
+		if( !c->node )
+			return 0;
+		c->hit = c->node->slot;
+		c->node = resTree_next_ending( &v->days, c->node, c->day );
+		return 1;
+
+	case CURSOR_RANGE:
+		if( c->node && v->starts[c->node->slot] > c->to )
+			c->node = NULL;
+		if( c->nextseries >= 0 && (!c->node || c->nextstart < v->starts[c->node->slot]) )
+			return cursor_take_occurrence( c );
+		if( !c->node )
+			return 0;
+		c->hit = c->node->slot;
+		c->node = resTree_next_ending( &v->timeline, c->node, c->from );
+		return 1;
+
+	case CURSOR_ROOM:
+		if( !c->node )
+			return 0;
+		c->hit = c->node->slot;
+		c->node = resTree_next( c->node );
+		return 1;
+
+	case CURSOR_WORD:
+		if( c->count == 0 )
+			return 0;
+		c->hit = c->q.hits[0];
+		c->q.hits[0] = c->q.hits[--c->count];
+		hit_sift_down( c->q.hits, c->count, 0 );
+		return 1;
+
+	case CURSOR_DESC:
+		while( c->pos == c->count && c->scanned < v->count )
 		{
-			if( resSize == 0 )
-			{
-				resSize = 5;
-				resRooms = calloc( resSize, sizeof(size_t) );	// REQ4
-				if( !resRooms )	// REQ6
-				{
-					fputs( "Error allocating memory to return reservations for a word search in the description.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations for a word search in the description. Quitting the program." );
-					exit(1);
-				}
-			}
-
-			if( resCount == resSize )
-			{
-				resSize *= 2;
-				resRooms = realloc( resRooms, sizeof(size_t) * resSize );	// REQ4
-				if( !resRooms )	// REQ6
-				{
-					fputs( "Error reallocating memory to return reservations for a particular room.", stderr );
-					snprintf( RES_ERROR_STR, BUFF, "Error retrieving available reservations for a particular room. Quitting the program." );
-					exit(1);	
-				}
-			}
-			resRooms[resCount++] = i;
+			int block = v->count - c->scanned < CURSOR_SCAN_BLOCK ? v->count - c->scanned : CURSOR_SCAN_BLOCK;
+			c->count = desc_scan_into( v->data + c->scanned, block, c->key, &c->q.hits, &c->q.hitsize );
+			for( int i = 0; i < c->count; i++ )
+				c->q.hits[i] += c->scanned;
+			c->pos = 0;
+			c->scanned += block;
 		}
+		if( c->pos == c->count )
+			return 0;
+		c->hit = c->q.hits[c->pos++];
+		return 1;
+
+	case CURSOR_SLOTS:
+		if( c->count == 0 )
+			return 0;
+		c->count = gaps_next( v, c->q.scratch, c->count, c->to, c->duration, &c->slot );
+		return 1;
+
+	case CURSOR_OCCURRENCES:
+		if( c->nextseries < 0 )
+			return 0;
+		return cursor_take_occurrence( c );
 	}
-	res_lookup_size = resCount;
-	qsort( resRooms, resCount, sizeof(size_t), sort_int );	// REQ5
+	return 0;
+}
+
+// At most limit more results are handed out; a negative limit lifts it
+void resCursor_limit( resCursor* c, int limit )
+{
+	c->limit = limit < 0 ? -1 : limit;
+}
 
-	return resRooms;
+// Passes over count results without counting them against the limit; returns how many there were
+int resCursor_skip( resCursor* c, int count )
+{
+	int skipped = 0;
+	if( c->kind == CURSOR_HITS )
+	{
+		skipped = count < c->count - c->pos ? count : c->count - c->pos;
+		c->pos += skipped;
+		return skipped;
+	}
+	while( skipped < count && cursor_step( c ) )
+		skipped++;
+	return skipped;
+}
+
+// Moves to the next result; returns 0 when there are no more or the limit is reached
+int resCursor_next( resCursor* c )
+{
+	c->occurrence.series = -1;
+	if( c->limit == 0 || !cursor_step( c ) )
+		return 0;
+	if( c->limit > 0 )
+		c->limit--;
+	return 1;
+}
+
+/***
+ * Copies up to pagesize more results into page and returns how many; for
+ * the searches answering with hit. occurrences[i] gets result i's series
+ * occurrence, with series -1 where page[i] holds a reservation instead.
+ * With occurrences NULL the occurrences are passed over.
+ */
+int resCursor_fetch( resCursor* c, size_t* page, resOccurrence* occurrences, int pagesize )
+{
+	int count = 0;
+	while( count < pagesize && resCursor_next( c ) )
+	{
+		if( c->occurrence.series >= 0 && !occurrences )
+			continue;
+		if( occurrences )
+			occurrences[count] = c->occurrence;
+		page[count++] = c->hit;
+	}
+	return count;
 }
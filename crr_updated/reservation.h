@@ -1,12 +1,17 @@
 #ifndef RESERVATION_H
 #define RESERVATION_H
 
+#include "res_arena.h"
+#include "res_avail.h"
+#include "res_tree.h"
+#include "res_words.h"
+
 #define BUFF 1024
 #define DESC_SIZE 129
 #define ROOM_NAME_LEN 49
 
 extern char RES_ERROR_STR[BUFF];
-extern int res_lookup_size;
+extern __thread int res_lookup_size;
 
 typedef struct Reservation {
 	char roomname[ROOM_NAME_LEN];
@@ -18,29 +23,209 @@ typedef struct Reservation {
 void res_error( FILE* fp, const char* functionname, int lineno, const char* op );
 time_t to_local( time_t t );
 time_t to_utc( time_t t );
+int res_local_day( time_t t );
+int res_day_weekday( int day );
 reservation create_reservation( const char* roomname, const time_t start, const time_t end, const char* desc );
 reservation* update_reservation( reservation* oldreservation, const char* newroomname, const time_t newstart, const time_t newend, const char* newdesc );
 void res_print_reservation( reservation* res );
 
+typedef struct Reservation_Room {
+	char roomname[ROOM_NAME_LEN];
+	resTree schedule;		// Reservations of this room ordered by start time
+	int* series;			// Ids of this room's recurring series, in no particular order
+	int seriescount;
+	int seriessize;
+} resRoom;
+
+/***
+ * data stays the record store in schedule.dat's own layout on purpose: it is
+ * what --mmap maps, what saves write out and where callers read the records
+ * a select found, so descriptions are not split off into a cold array. Scans
+ * that only need the room and times read the hot columns below instead.
+ */
 typedef struct Reservation_Vector {
-	reservation* data;
+	reservation* data;		// Full records in file format; descriptions are only read from here
 	int size;
 	int count;
+	int* roomids;			// Hot columns: room schedule id, start and end of data[i]
+	time_t* starts;
+	time_t* ends;
+	int* startdays;			// Local calendar days (days since 1970-01-01) data[i] starts and ends on
+	int* enddays;
+	resNode** nodes;		// nodes[i] is the room schedule node holding data[i]
+	resNode** timenodes;	// timenodes[i] is the timeline node holding data[i]
+	resNode** daynodes;		// daynodes[i] is the days node holding data[i]
+	resTree timeline;		// Every reservation ordered by start time, then room id
+	resTree days;			// Every reservation ordered by start day, then like the timeline, with end days
+	resWords words;			// Description words to slots
+	resAvail avail;			// Which room ids are taken in each time slot
+	resRoom* rooms;			// Indexed by room id
+	int* roomorder;			// Room ids sorted by room name, for resolving names
+	int roomcount;
+	int roomsize;
+	char** roomnames;		// The rooms.dat table interned as ids 0..internedrooms-1
+	int internedrooms;
+	int indexed;			// Zero until the columns and trees above are built for the loaded data
+	size_t mapped;			// Bytes mapped at data when it is served from a file mapping
+	int checkrooms;			// Consistency check deferred until the index is built
+	struct Reservation_Journal* journal;	// Receives every change when set
+	struct Reservation_Recurrence* series;	// Recurring reservations, one rule each
+	int* seriesrooms;		// Room id of series[i]
+	int seriescount;
+	int seriessize;
+	reservation occurrence;	// Series occurrence last returned as a conflict
 } resVect;
 
+typedef struct Import_Conflict {
+	int existing;			// Index of the reservation in the way, or -1
+	int incoming;			// Position of the imported reservation in the way, or -1
+	int series;				// Recurring series in the way, or -1
+} resImportConflict;
+
+typedef struct Import_Key {
+	int roomid;
+	time_t start;
+	int pos;
+} importKey;
+
+typedef struct Free_Slot {
+	size_t room;			// Index into the rooms searched
+	time_t start;			// Local times, like the keys given to the selects
+	time_t end;
+} resFreeSlot;
+
+typedef struct Series_Occurrence {
+	int series;				// Index of the recurring series
+	int k;					// Occurrence number in the series
+	reservation res;
+} resOccurrence;
+
+/***
+ * Result buffers for the resVect_query_* searches, kept by the caller and
+ * reused. Each query overwrites what the last one found and returns the
+ * count; the buffers only ever grow, so once they are big enough a query
+ * makes no allocations at all. One resQuery serves one thread at a time.
+ *
+ * With arena set the buffers come from it instead of malloc, and are only
+ * given back when it is reset, so the query must not be used past that.
+ */
+typedef struct Reservation_Query {
+	size_t* hits;			// Positions in the vector, or indices into rooms for free rooms
+	int hitsize;
+	resFreeSlot* slots;
+	int slotsize;
+	resOccurrence* occurrences;	// Series occurrences found by the occurrences, day and range queries
+	int occurrencesize;
+	int occurrencecount;
+	void* scratch;			// Working space of the free room and free slot searches
+	size_t scratchsize;
+	resArena* arena;		// NULL to use malloc
+} resQuery;
+
+enum res_cursor_kind {
+	CURSOR_HITS,			// Results worked out when opened and waiting in q.hits
+	CURSOR_DAY,
+	CURSOR_RANGE,
+	CURSOR_ROOM,
+	CURSOR_WORD,
+	CURSOR_DESC,
+	CURSOR_SLOTS,
+	CURSOR_OCCURRENCES
+};
+
+/***
+ * A search handed out one result at a time. Each resCursor_open_* answers
+ * the same question as the matching select, in the same order, but only
+ * finds the next result when resCursor_next is called; a caller that stops
+ * early skips the rest of the work. The result is left in hit (a position
+ * in the vector, or an index into rooms for the free room searches), slot
+ * or occurrence, depending on the search. The day and range searches hand
+ * out series occurrences among the reservations, in start order;
+ * occurrence.series is -1 unless the result is one.
+ *
+ * The cursor reads the indexes as it goes, so the schedule must not change
+ * between opening it and the last resCursor_next. Reopening a cursor reuses
+ * its buffers; resCursor_close frees them. Setting q.arena before the
+ * first open puts the buffers on that arena instead.
+ */
+typedef struct Reservation_Cursor {
+	resVect* v;
+	int kind;
+	int limit;				// Results still to hand out, or -1 for no limit
+	resQuery q;				// Results found ahead, the word heap, or the free slot heap
+	int pos;				// Next of the count results waiting in q.hits
+	int count;
+	resNode* node;			// Next node of a tree walk
+	time_t from;
+	time_t to;
+	int day;
+	time_t duration;
+	int scanned;			// Records the description scan has been through
+	char key[DESC_SIZE];
+	size_t hit;
+	resFreeSlot slot;
+	resOccurrence occurrence;
+	int nextseries;			// Series holding the earliest occurrence still to hand out, or -1
+	time_t nextstart;
+} resCursor;
+
 void resVect_init( resVect* v );
+void resVect_set_rooms( resVect* v, char** rooms, int numrooms );
 int resVect_count( resVect* v );
+void resVect_need_index( resVect* v );
 reservation* resVect_add( resVect* v, reservation res );
+int resVect_import( resVect* v, reservation* incoming, int n, resImportConflict* conflicts );
 void resVect_set( resVect* v, int index, reservation res );
+reservation* resVect_update( resVect* v, int index, reservation res );
 reservation* resVect_get( resVect* v, int index );
+int resVect_find( resVect* v, reservation* res );
 void resVect_delete( resVect* v, int index );
 void resVect_free( resVect* v );
-void resVect_write_file( resVect* v, char* filename );
+int resVect_write_file( resVect* v, char* filename );
 void resVect_read_file( resVect* v, char* filename );
+void resVect_map_file( resVect* v, char* filename );
+reservation* resVect_add_series( resVect* v, struct Reservation_Recurrence* series );
+int resVect_find_series( resVect* v, reservation* first );
+int resVect_skip_occurrence( resVect* v, int series, int k );
+void resVect_delete_series( resVect* v, int series );
+void resVect_read_series( resVect* v, char* filename );
 void resVect_check_consistency( resVect* v, char** rooms, int numrooms );
 size_t* resVect_select_room_at_time( resVect* v, time_t key, char** rooms, int numrooms );
+size_t* resVect_select_free_rooms( resVect* v, time_t start, time_t end, char** rooms, int numrooms );
 size_t* resVect_select_res_day( resVect* v, time_t key );
+size_t* resVect_select_res_range( resVect* v, time_t start, time_t end );
+resOccurrence* resVect_select_occurrences( resVect* v, time_t start, time_t end );
+resFreeSlot* resVect_select_free_slots( resVect* v, time_t start, time_t end, time_t duration, char** rooms, int numrooms, int wanted );
 size_t* resVect_select_res_room( resVect* v, char* key );
+size_t* resVect_select_res_word( resVect* v, char* key );
 size_t* resVect_select_res_desc( resVect* v, char* key );
 
+void resQuery_init( resQuery* q );
+void resQuery_free( resQuery* q );
+int resVect_query_room_at_time( resVect* v, resQuery* q, time_t key, char** rooms, int numrooms );
+int resVect_query_free_rooms( resVect* v, resQuery* q, time_t start, time_t end, char** rooms, int numrooms );
+int resVect_query_res_day( resVect* v, resQuery* q, time_t key );
+int resVect_query_res_range( resVect* v, resQuery* q, time_t start, time_t end );
+int resVect_query_occurrences( resVect* v, resQuery* q, time_t start, time_t end );
+int resVect_query_free_slots( resVect* v, resQuery* q, time_t start, time_t end, time_t duration, char** rooms, int numrooms, int wanted );
+int resVect_query_res_room( resVect* v, resQuery* q, char* key );
+int resVect_query_res_word( resVect* v, resQuery* q, char* key );
+int resVect_query_res_desc( resVect* v, resQuery* q, char* key );
+
+void resCursor_init( resCursor* c );
+void resCursor_close( resCursor* c );
+void resCursor_open_room_at_time( resCursor* c, resVect* v, time_t key, char** rooms, int numrooms );
+void resCursor_open_free_rooms( resCursor* c, resVect* v, time_t start, time_t end, char** rooms, int numrooms );
+void resCursor_open_res_day( resCursor* c, resVect* v, time_t key );
+void resCursor_open_res_range( resCursor* c, resVect* v, time_t start, time_t end );
+void resCursor_open_occurrences( resCursor* c, resVect* v, time_t start, time_t end );
+void resCursor_open_free_slots( resCursor* c, resVect* v, time_t start, time_t end, time_t duration, char** rooms, int numrooms );
+void resCursor_open_res_room( resCursor* c, resVect* v, char* key );
+void resCursor_open_res_word( resCursor* c, resVect* v, char* key );
+void resCursor_open_res_desc( resCursor* c, resVect* v, char* key );
+void resCursor_limit( resCursor* c, int limit );
+int resCursor_skip( resCursor* c, int count );
+int resCursor_next( resCursor* c );
+int resCursor_fetch( resCursor* c, size_t* page, resOccurrence* occurrences, int pagesize );
+
 #endif
@@ -6,37 +6,42 @@
 #include "reservation.h"
 #include "search_sort_utils.h"
 
-int sort_name_time( const void* left, const void* right )	// REQ5
+static void swap_bytes( char* left, char* right, size_t size )
 {
-	const reservation *mleft = (const reservation*)left;
-	const reservation *mright = (const reservation*)right;
-	if( strcasecmp( mleft->roomname, mright->roomname ) < 0 )
+	for( size_t i = 0; i < size; i++ )
 	{
-		return -1;
-	} else if( strcasecmp( mleft->roomname, mright->roomname ) > 0 ) {
-		return 1;
-	} else {
-		size_t left_t = mleft->starttime;
-		size_t right_t = mright->starttime;
-		if( left_t < right_t )
-			return -1;
-		else if( left_t > right_t )
-			return 1;
-	} 
-	return 0;
+		char temp = left[i];
+		left[i] = right[i];
+		right[i] = temp;
+	}
 }
 
-int sort_time_name( const void* left, const void* right )	// REQ5
+static void sift_down( char* base, size_t root, size_t count, size_t size, int (*cmp)( const void*, const void* ) )
 {
-	const reservation *mleft = (const reservation*)left;
-	const reservation *mright = (const reservation*)right;
-	if( mleft->starttime < mright->starttime ) 
+	for( size_t child; (child = 2 * root + 1) < count; root = child )
 	{
-		return -1;
-	} else if( mleft->starttime > mright->starttime ) {
-		return 1;
-	} else {
-		return ( strcasecmp( mleft->roomname, mright->roomname) );
+		if( child + 1 < count && cmp( base + child * size, base + (child + 1) * size ) < 0 )
+			child++;
+		if( cmp( base + root * size, base + child * size ) >= 0 )
+			return;
+		swap_bytes( base + root * size, base + child * size, size );
+	}
+}
+
+/***
+ * Heap sort taking the same comparators as qsort. glibc's qsort mallocs a
+ * merge buffer for anything over a kilobyte; this never allocates, which
+ * the resVect_query_* searches rely on.
+ */
+void sort_in_place( void* base, size_t count, size_t size, int (*cmp)( const void*, const void* ) )		// REQ5
+{
+	char* bytes = base;
+	for( size_t root = count / 2; root-- > 0; )
+		sift_down( bytes, root, count, size, cmp );
+	for( size_t end = count; end-- > 1; )
+	{
+		swap_bytes( bytes, bytes + end * size, size );
+		sift_down( bytes, 0, end, size, cmp );
 	}
 }
 
@@ -58,6 +63,47 @@ int sort_size_t( const void* left, const void* right )		// REQ5
 	return 0;
 }
 
+int sort_long( const void* left, const void* right )		// REQ5
+{
+	const long mleft = *(const long*)left;
+	const long mright = *(const long*)right;
+	if( mleft < mright )
+		return -1;
+	else if( mleft > mright )
+		return 1;
+	return 0;
+}
+
+// Orders import keys by room id, then start, then position in the import
+int sort_import_key( const void* left, const void* right )	// REQ5
+{
+	const importKey* l = (const importKey*)left;
+	const importKey* r = (const importKey*)right;
+
+	if( l->roomid != r->roomid )
+		return l->roomid < r->roomid ? -1 : 1;
+	if( l->start != r->start )
+		return l->start < r->start ? -1 : 1;
+	return l->pos - r->pos;
+}
+
+// Orders reservation records by start, then room name, like the timeline
+int sort_res_start( const void* left, const void* right )	// REQ5
+{
+	const reservation* l = (const reservation*)left;
+	const reservation* r = (const reservation*)right;
+
+	if( l->starttime != r->starttime )
+		return l->starttime < r->starttime ? -1 : 1;
+	return strcasecmp( l->roomname, r->roomname );
+}
+
+// Orders series occurrences like sort_res_start
+int sort_occurrence_start( const void* left, const void* right )	// REQ5
+{
+	return sort_res_start( &((const resOccurrence*)left)->res, &((const resOccurrence*)right)->res );
+}
+
 int bsearch_room_cmp( const void* key, const void* element )	// REQ5
 {
 	const char* k = (const char*)key;
@@ -66,66 +112,85 @@ int bsearch_room_cmp( const void* key, const void* element )	// REQ5
 	return strcasecmp( k, ele );
 }
 
-int bsearch_res_room_cmp( const void* key, const void* element )	// REQ5
+int tree_start_cmp( const void* ctx, int leftslot, int rightslot )
 {
-	const char* k = (const char*)key;
-	const reservation* res = (const reservation*)element;
+	const resVect* v = (const resVect*)ctx;
+	time_t left_t = v->starts[leftslot];
+	time_t right_t = v->starts[rightslot];
 
-	return strcasecmp( k, res->roomname );
+	if( left_t < right_t )
+		return -1;
+	else if( left_t > right_t )
+		return 1;
+	return 0;
 }
 
-int bsearch_time_cmp( const void* key, const void* element )	// REQ5
+int tree_time_room_cmp( const void* ctx, int leftslot, int rightslot )
 {
-	const time_t* k = (const time_t*)key;
-	const reservation* res = (const reservation*)element;
+	const resVect* v = (const resVect*)ctx;
+	int cmp = tree_start_cmp( ctx, leftslot, rightslot );
+	if( cmp != 0 )
+		return cmp;
 
-	time_t lower = res->starttime;
-	time_t upper = res->endtime;
+	// Interned room ids follow the sorted rooms.dat order
+	return v->roomids[leftslot] - v->roomids[rightslot];
+}
 
-	if( *k < lower )
-	{
+int tree_start_key_cmp( const void* ctx, const void* key, int slot )
+{
+	const resVect* v = (const resVect*)ctx;
+	const time_t* k = (const time_t*)key;
+
+	if( *k < v->starts[slot] )
 		return -1;
-	} else if( *k > upper ) {
+	else if( *k > v->starts[slot] )
 		return 1;
-	} else if( *k >= lower && *k <= upper ) {
-		return 0;
-	}
+	return 0;
 }
 
-int bsearch_day_cmp( const void* key, const void* element )		// REQ5
+int tree_end_key_cmp( const void* ctx, const void* key, int slot )
 {
+	const resVect* v = (const resVect*)ctx;
 	const time_t* k = (const time_t*)key;
-	const reservation* res = (const reservation*)element;
-	time_t res_t_start = to_local( res->starttime );
-	time_t res_t_end = to_local( res->endtime );
-	struct tm restm_start;
-	struct tm restm_end;
-	localtime_r( &res_t_start, &restm_start );
-	localtime_r( &res_t_end, &restm_end );
-	struct tm ktm;
-	localtime_r( k, &ktm );
-
-	if( ktm.tm_wday < restm_start.tm_wday )
+
+	if( *k < v->ends[slot] )
 		return -1;
-	else if( ktm.tm_wday > restm_end.tm_wday )
+	else if( *k > v->ends[slot] )
 		return 1;
 	return 0;
 }
 
-int bsearch_conflict( const void* key, const void* element )	// REQ5, REQ7
+// Orders by local start day, then like the timeline
+int tree_day_cmp( const void* ctx, int leftslot, int rightslot )
 {
-	const reservation* k = (const reservation*)key;
-	const reservation* res = (const reservation*)element;
+	const resVect* v = (const resVect*)ctx;
+	if( v->startdays[leftslot] != v->startdays[rightslot] )
+		return v->startdays[leftslot] < v->startdays[rightslot] ? -1 : 1;
+	return tree_time_room_cmp( ctx, leftslot, rightslot );
+}
 
-	if( strcasecmp( k->roomname, res->roomname ) < 0 )
+int tree_day_key_cmp( const void* ctx, const void* key, int slot )
+{
+	const resVect* v = (const resVect*)ctx;
+	const int* k = (const int*)key;
+
+	if( *k < v->startdays[slot] )
 		return -1;
-	else if( strcasecmp( k->roomname, res->roomname ) > 0 )
+	else if( *k > v->startdays[slot] )
 		return 1;
-	else {
-		if( k->endtime <= res->starttime )
-			return -1;
-		else if( k->starttime >= res->endtime )
-			return 1;
-	}
 	return 0;
 }
+
+// End time of a slot, which the timeline keeps the latest of in every subtree
+time_t tree_slot_end( const void* ctx, int slot )
+{
+	const resVect* v = (const resVect*)ctx;
+	return v->ends[slot];
+}
+
+// End day of a slot, which the days tree keeps the latest of in every subtree
+time_t tree_slot_endday( const void* ctx, int slot )
+{
+	const resVect* v = (const resVect*)ctx;
+	return v->enddays[slot];
+}
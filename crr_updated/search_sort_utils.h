@@ -1,14 +1,23 @@
 #ifndef SEARCH_SORT_H
 #define SEARCH_SORT_H
 
-int sort_name_time( const void* left, const void* right );
-int sort_time_name( const void* left, const void* right );
+#include <stddef.h>
+
+void sort_in_place( void* base, size_t count, size_t size, int (*cmp)( const void*, const void* ) );
 int sort_int( const void* left, const void* right );
 int sort_size_t( const void* left, const void* right );
+int sort_long( const void* left, const void* right );
+int sort_import_key( const void* left, const void* right );
+int sort_res_start( const void* left, const void* right );
+int sort_occurrence_start( const void* left, const void* right );
 int bsearch_room_cmp( const void* key, const void* element );
-int bsearch_res_room_cmp( const void* key, const void* element );
-int bsearch_time_cmp( const void* key, const void* element );
-int bsearch_day_cmp( const void* key, const void* element );
-int bsearch_conflict( const void* key, const void* element );
+int tree_start_cmp( const void* ctx, int leftslot, int rightslot );
+int tree_time_room_cmp( const void* ctx, int leftslot, int rightslot );
+int tree_start_key_cmp( const void* ctx, const void* key, int slot );
+int tree_end_key_cmp( const void* ctx, const void* key, int slot );
+int tree_day_cmp( const void* ctx, int leftslot, int rightslot );
+int tree_day_key_cmp( const void* ctx, const void* key, int slot );
+time_t tree_slot_end( const void* ctx, int slot );
+time_t tree_slot_endday( const void* ctx, int slot );
 
 #endif